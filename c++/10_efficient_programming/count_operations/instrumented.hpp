@@ -43,7 +43,7 @@ struct instrumented : instrumented_base {
 
   // Semiregular:
   instrumented(const instrumented& x) : value{x.value} { ++counts[copy_ctor]; }
-  instrumented(instrumented&& x) : value{std::move(x)} { ++counts[move_ctor]; }
+  instrumented(instrumented&& x) : value{std::move(x.value)} { ++counts[move_ctor]; }
   instrumented() { ++counts[default_ctor]; }
   ~instrumented() { ++counts[dtor]; }
 
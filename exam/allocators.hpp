@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include <sys/mman.h>
+
+/*
+  allocators for the storage of a stack_pool, to be passed as its
+  Allocator template parameter. both are stateless, so any two instances
+  compare equal and memory can be released by any copy.
+*/
+
+/*
+  allocations of at least huge_page_size bytes are served by mmap with
+  the address aligned to 2 MiB and marked with madvise(MADV_HUGEPAGE),
+  so that the kernel can back them with transparent huge pages: a pool
+  of hundreds of MB then needs a few hundred TLB entries instead of
+  hundreds of thousands. smaller allocations go to operator new, since a
+  huge page would waste most of its memory.
+*/
+template <typename T>
+struct huge_page_allocator {
+  using value_type = T;
+
+  static constexpr std::size_t huge_page_size = std::size_t(1) << 21;
+
+  huge_page_allocator() noexcept = default;
+  template <typename U>
+  huge_page_allocator(const huge_page_allocator<U>&) noexcept {}
+
+  T* allocate(std::size_t n) {
+    const std::size_t bytes = n * sizeof(T);
+    if (bytes < huge_page_size)
+      return static_cast<T*>(::operator new(bytes));
+
+    // map one more huge page, then unmap what lies outside the aligned range
+    const std::size_t len = round_up(bytes);
+    void* p = ::mmap(nullptr, len + huge_page_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+      throw std::bad_alloc{};
+    const auto raw = reinterpret_cast<std::uintptr_t>(p);
+    const auto aligned =
+        (raw + huge_page_size - 1) & ~std::uintptr_t(huge_page_size - 1);
+    if (aligned != raw)
+      ::munmap(p, aligned - raw);
+    const std::size_t tail = huge_page_size - (aligned - raw);
+    if (tail != 0)
+      ::munmap(reinterpret_cast<void*>(aligned + len), tail);
+    ::madvise(reinterpret_cast<void*>(aligned), len, MADV_HUGEPAGE);
+    return reinterpret_cast<T*>(aligned);
+  }
+
+  void deallocate(T* p, std::size_t n) noexcept {
+    const std::size_t bytes = n * sizeof(T);
+    if (bytes < huge_page_size)
+      ::operator delete(p);
+    else
+      ::munmap(p, round_up(bytes));
+  }
+
+ private:
+  static std::size_t round_up(std::size_t bytes) noexcept {
+    return (bytes + huge_page_size - 1) & ~(huge_page_size - 1);
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const huge_page_allocator<T>&, const huge_page_allocator<U>&) {
+  return true;
+}
+template <typename T, typename U>
+bool operator!=(const huge_page_allocator<T>&, const huge_page_allocator<U>&) {
+  return false;
+}
+
+/*
+  every allocation starts at a multiple of Align (a cache line by
+  default), so that the first node never straddles two cache lines and
+  two pools never share the line where one ends and the other begins.
+*/
+template <typename T, std::size_t Align = 64>
+struct cache_aligned_allocator {
+  static_assert(Align >= alignof(T) && (Align & (Align - 1)) == 0,
+                "Align must be a power of two not smaller than alignof(T)");
+  using value_type = T;
+
+  template <typename U>
+  struct rebind {
+    using other = cache_aligned_allocator<U, Align>;
+  };
+
+  cache_aligned_allocator() noexcept = default;
+  template <typename U>
+  cache_aligned_allocator(const cache_aligned_allocator<U, Align>&) noexcept {}
+
+  T* allocate(std::size_t n) {
+    void* p = nullptr;
+    if (::posix_memalign(&p, Align, n * sizeof(T)) != 0)
+      throw std::bad_alloc{};
+    return static_cast<T*>(p);
+  }
+
+  void deallocate(T* p, std::size_t) noexcept { std::free(p); }
+};
+
+template <typename T, typename U, std::size_t Align>
+bool operator==(const cache_aligned_allocator<T, Align>&,
+                const cache_aligned_allocator<U, Align>&) {
+  return true;
+}
+template <typename T, typename U, std::size_t Align>
+bool operator!=(const cache_aligned_allocator<T, Align>&,
+                const cache_aligned_allocator<U, Align>&) {
+  return false;
+}
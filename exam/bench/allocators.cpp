@@ -0,0 +1,66 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../allocators.hpp"
+#include "../stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  one stack of n nodes (2^25 by default, i.e. 512 MB of nodes) whose
+  links jump randomly through the pool: every step of the traversal is a
+  cache miss and, with 4 KiB pages, a TLB miss as well. the same stack
+  is traversed with the nodes allocated by std::allocator, by the huge
+  page allocator and by the cache aligned allocator. AnonHugePages is
+  the memory the kernel is backing with transparent huge pages.
+*/
+std::string anon_huge_pages() {
+  std::ifstream smaps{"/proc/self/smaps_rollup"};
+  std::string line;
+  while (std::getline(smaps, line))
+    if (line.compare(0, 14, "AnonHugePages:") == 0)
+      return line.substr(14);
+  return "n/a";
+}
+
+template <typename Allocator>
+void run(const std::string& name, const std::vector<std::size_t>& order) {
+  const std::size_t n = order.size();
+  stack_pool<long, std::size_t, aos_layout, Allocator> pool{n};
+  pool.push_n(n, 0, pool.new_stack());
+  for (std::size_t i = 0; i < n; ++i) {
+    pool.value(order[i]) = long(i);
+    pool.next(order[i]) = i + 1 < n ? order[i + 1] : pool.end();
+  }
+  const auto head = order.front();
+
+  double best = 1e300;
+  for (int r = 0; r < 3; ++r)
+    best = std::min(best, seconds([&]() {
+      do_not_optimize(*std::max_element(pool.begin(head), pool.end(head)));
+    }));
+
+  std::cout << std::setw(16) << name << std::setw(16) << best * 1e9 / n
+            << std::setw(24) << anon_huge_pages() << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  const std::size_t n =
+      argc > 1 ? std::strtoull(argv[1], nullptr, 10) : std::size_t(1) << 25;
+  std::vector<std::size_t> order(n);
+  std::iota(order.begin(), order.end(), std::size_t(1));
+  std::shuffle(order.begin(), order.end(), std::mt19937_64{3});
+
+  std::cout << "random traversal of " << n << " nodes" << std::endl;
+  std::cout << std::setw(16) << "allocator" << std::setw(16) << "[ns/node]"
+            << std::setw(24) << "AnonHugePages" << std::endl;
+  run<std::allocator<long>>("std", order);
+  run<huge_page_allocator<long>>("huge pages", order);
+  run<cache_aligned_allocator<long>>("cache aligned", order);
+}
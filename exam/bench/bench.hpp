@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <malloc.h>
+
+/*
+  small helpers shared by the benchmarks in this folder:
+  they only time a callable, printing is left to each benchmark.
+*/
+template <typename F>
+double seconds(F&& f) {
+  const auto t0 = std::chrono::steady_clock::now();
+  std::forward<F>(f)();
+  const auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(t1 - t0).count();
+}
+
+// keep the optimizer from dropping a computed value
+template <typename T>
+void do_not_optimize(const T& x) {
+  asm volatile("" : : "g"(&x) : "memory");
+}
+
+/*
+  call run, which times one repetition of a workload (setting it up
+  outside the timed part) and returns the seconds taken, repeats times:
+  the result is sorted, so front() is the best time and the median is
+  in the middle.
+*/
+template <typename F>
+std::vector<double> repeat(std::size_t repeats, F&& run) {
+  std::vector<double> times;
+  times.reserve(repeats);
+  for (std::size_t i = 0; i < repeats; ++i)
+    times.push_back(run());
+  std::sort(times.begin(), times.end());
+  return times;
+}
+
+// bytes allocated with malloc, large blocks (mapped one by one) included
+inline std::size_t heap_in_use() {
+  const auto m = mallinfo2();
+  return m.uordblks + m.hblkhd;
+}
@@ -0,0 +1,70 @@
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "../stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  build stacks of n values taken from a vector, either with a loop of
+  push or with push_range, first on an empty pool (all nodes appended)
+  and then after popping everything with pop_n (all nodes reused).
+*/
+constexpr std::size_t n = 1 << 22;
+constexpr int reps = 5;
+
+template <typename T, typename Layout>
+void run(const std::string& name) {
+  std::vector<T> v(n);
+  std::iota(v.begin(), v.end(), T{});
+
+  double loop_fresh = 0, loop_reuse = 0, bulk_fresh = 0, bulk_reuse = 0;
+  for (int r = 0; r < reps; ++r) {
+    {
+      stack_pool<T, std::size_t, Layout> pool{};
+      auto l = pool.new_stack();
+      loop_fresh += seconds([&]() {
+        for (const auto& x : v)
+          l = pool.push(x, l);
+      });
+      l = pool.pop_n(l, n);
+      loop_reuse += seconds([&]() {
+        for (const auto& x : v)
+          l = pool.push(x, l);
+      });
+      do_not_optimize(l);
+    }
+    {
+      stack_pool<T, std::size_t, Layout> pool{};
+      auto l = pool.new_stack();
+      bulk_fresh +=
+          seconds([&]() { l = pool.push_range(v.begin(), v.end(), l); });
+      l = pool.pop_n(l, n);
+      bulk_reuse +=
+          seconds([&]() { l = pool.push_range(v.begin(), v.end(), l); });
+      do_not_optimize(l);
+    }
+  }
+
+  const double scale = 1e9 / (double(n) * reps);
+  std::cout << std::setw(12) << name << std::setw(14) << loop_fresh * scale
+            << std::setw(14) << bulk_fresh * scale << std::setw(14)
+            << loop_reuse * scale << std::setw(14) << bulk_reuse * scale
+            << std::endl;
+}
+
+int main() {
+  std::cout << std::setw(12) << "" << std::setw(28) << "fresh nodes [ns]"
+            << std::setw(28) << "free nodes [ns]" << std::endl;
+  std::cout << std::setw(12) << "T/layout" << std::setw(14) << "push"
+            << std::setw(14) << "push_range" << std::setw(14) << "push"
+            << std::setw(14) << "push_range" << std::endl;
+  run<char, aos_layout>("char/aos");
+  run<char, soa_layout>("char/soa");
+  run<int, aos_layout>("int/aos");
+  run<int, soa_layout>("int/soa");
+  run<double, aos_layout>("double/aos");
+  run<double, soa_layout>("double/soa");
+}
@@ -0,0 +1,83 @@
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  speculative work on a large pool: 1000 stacks hold n ints (1e7 by
+  default, or argv[1]), then k random pushes and pops (half and half)
+  are made and undone, for k from 100 to 1e6. we time the k operations
+  without and with a checkpoint open (which logs the changes to the
+  nodes older than the checkpoint), and undoing them with rollback,
+  against the simplest alternative: a copy of the pool taken before,
+  whose cost depends on the size of the pool and not on k.
+*/
+constexpr std::size_t n_stacks = 1000;
+using pool_type = stack_pool<int, std::uint32_t>;
+
+template <typename F>
+double best(F f) {
+  return repeat(3, f).front();
+}
+
+void churn(pool_type& pool, std::vector<std::uint32_t>& heads, const std::vector<std::uint32_t>& which,
+           std::size_t k) {
+  for (std::size_t i = 0; i < k; ++i) {
+    auto& h = heads[which[i] % n_stacks];
+    if (which[i] >> 31)
+      h = pool.push(int(i), h);
+    else
+      h = pool.pop(h);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  const std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+  pool_type pool{};
+  std::vector<std::uint32_t> heads(n_stacks, pool.new_stack());
+  std::mt19937 gen{42};
+  for (std::size_t i = 0; i < n; ++i) {
+    auto& h = heads[gen() % n_stacks];
+    h = pool.push(int(i), h);
+  }
+  std::vector<std::uint32_t> which(1000000);
+  for (auto& w : which)
+    w = gen();
+
+  const double t_copy = best([&]() {
+    return seconds([&]() {
+      pool_type copy{pool};
+      do_not_optimize(copy);
+    });
+  });
+
+  std::cout << std::setw(10) << "k" << std::setw(14) << "op [ns]" << std::setw(14)
+            << "logged [ns]" << std::setw(16) << "rollback [us]" << std::setw(16)
+            << "copy pool [us]" << std::endl;
+  for (std::size_t k = 100; k <= which.size(); k *= 100) {
+    const auto saved = heads;
+    const double t_plain = best([&]() {
+      pool_type copy{pool};
+      copy.reserve(pool.capacity() + k);  // room for the pushes: a copy has no spare capacity
+      auto h = saved;
+      return seconds([&]() { churn(copy, h, which, k); });
+    });
+    double t_rollback = 1e9;
+    const double t_logged = best([&]() {
+      heads = saved;
+      const auto cp = pool.checkpoint();
+      const double t = seconds([&]() { churn(pool, heads, which, k); });
+      t_rollback = std::min(t_rollback, seconds([&]() { pool.rollback(cp); }));
+      return t;
+    });
+    heads = saved;
+    std::cout << std::setw(10) << k << std::setw(14) << t_plain * 1e9 / k << std::setw(14)
+              << t_logged * 1e9 / k << std::setw(16) << t_rollback * 1e6 << std::setw(16)
+              << t_copy * 1e6 << std::endl;
+  }
+}
@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  the pool first grows to a peak of 4M nodes, then most of them are
+  popped and random pushes and pops on random stacks scatter the live
+  nodes. we compare the traversal of every stack (max_element) and the
+  resident memory of the process before compaction, after compact() and
+  for a pool freshly built with the same stacks.
+*/
+using pool_type = stack_pool<long, std::size_t>;
+
+constexpr std::size_t n_stacks = 1 << 10;
+constexpr std::size_t peak = 1 << 22;
+constexpr std::size_t live = 1 << 20;
+constexpr std::size_t churn = 1 << 23;
+
+double resident_mb() {
+  std::ifstream statm{"/proc/self/statm"};
+  std::size_t size = 0, resident = 0;
+  statm >> size >> resident;
+  return double(resident) * sysconf(_SC_PAGESIZE) / (1 << 20);
+}
+
+double traversal_ns(pool_type& pool, const std::vector<std::size_t>& heads) {
+  std::size_t n = 0;
+  const double t = seconds([&]() {
+    for (auto h : heads) {
+      do_not_optimize(std::max_element(pool.begin(h), pool.end(h)));
+      n += std::distance(pool.begin(h), pool.end(h));
+    }
+  });
+  return t * 1e9 / n;
+}
+
+void report(const std::string& what, double ns) {
+  std::cout << std::setw(20) << what << std::setw(16) << ns << std::setw(16)
+            << resident_mb() << std::endl;
+}
+
+int main() {
+  std::cout << std::setw(20) << "" << std::setw(16) << "traversal [ns]"
+            << std::setw(16) << "RSS [MB]" << std::endl;
+
+  std::mt19937 gen{7};
+  std::uniform_int_distribution<std::size_t> pick{0, n_stacks - 1};
+  pool_type pool{};
+  std::vector<std::size_t> heads(n_stacks, pool.new_stack());
+  std::vector<std::size_t> sizes(n_stacks, 0);
+
+  for (std::size_t i = 0; i < peak; ++i) {
+    const auto s = pick(gen);
+    heads[s] = pool.push(long(i), heads[s]);
+    ++sizes[s];
+  }
+  report("peak", traversal_ns(pool, heads));
+
+  for (std::size_t i = live; i < peak;) {
+    const auto s = pick(gen);
+    if (sizes[s] > 0) {
+      heads[s] = pool.pop(heads[s]);
+      --sizes[s];
+      ++i;
+    }
+  }
+  for (std::size_t i = 0; i < churn; ++i) {
+    const auto s = pick(gen);
+    if (i % 2 == 0) {
+      heads[s] = pool.push(long(i), heads[s]);
+      ++sizes[s];
+    } else if (sizes[s] > 0) {
+      heads[s] = pool.pop(heads[s]);
+      --sizes[s];
+    }
+  }
+  report("after churn", traversal_ns(pool, heads));
+
+  heads = pool.compact(heads);
+  report("compacted", traversal_ns(pool, heads));
+
+  // the same stacks pushed from scratch, one after the other
+  pool_type fresh{};
+  std::vector<std::size_t> fresh_heads;
+  for (auto h : heads) {
+    std::vector<long> values{pool.begin(h), pool.end(h)};
+    fresh_heads.push_back(
+        fresh.push_range(values.rbegin(), values.rend(), fresh.new_stack()));
+  }
+  report("freshly built", traversal_ns(fresh, fresh_heads));
+}
@@ -0,0 +1,82 @@
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../concurrent_stack_pool.hpp"
+#include "../stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  every thread owns one stack: it pushes a burst of values and then pops
+  them all, so that each round recycles nodes through the free list.
+  the same work is done on a stack_pool guarded by a mutex as baseline.
+*/
+constexpr std::size_t burst = 64;
+constexpr std::size_t rounds = 1 << 14;
+
+template <typename Pool>
+void lock_free_worker(Pool& pool, unsigned id) {
+  auto l = pool.new_stack();
+  for (std::size_t r = 0; r < rounds; ++r) {
+    for (std::size_t i = 0; i < burst; ++i)
+      l = pool.push(int(id + i), l);
+    for (std::size_t i = 0; i < burst; ++i)
+      l = pool.pop(l);
+  }
+}
+
+template <typename Pool>
+void locked_worker(Pool& pool, std::mutex& m, unsigned id) {
+  auto l = pool.new_stack();
+  for (std::size_t r = 0; r < rounds; ++r) {
+    for (std::size_t i = 0; i < burst; ++i) {
+      std::lock_guard<std::mutex> lock{m};
+      l = pool.push(int(id + i), l);
+    }
+    for (std::size_t i = 0; i < burst; ++i) {
+      std::lock_guard<std::mutex> lock{m};
+      l = pool.pop(l);
+    }
+  }
+}
+
+template <typename F>
+double run(unsigned n_threads, F f) {
+  return seconds([&]() {
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < n_threads; ++t)
+      threads.emplace_back(f, t);
+    for (auto& t : threads)
+      t.join();
+  });
+}
+
+int main(int argc, char* argv[]) {
+  unsigned max_threads = std::thread::hardware_concurrency();
+  if (argc > 1)
+    max_threads = std::stoul(argv[1]);
+  if (max_threads == 0)
+    max_threads = 1;
+
+  std::cout << std::setw(8) << "threads" << std::setw(20) << "lock-free [Mop/s]"
+            << std::setw(20) << "mutex [Mop/s]" << std::endl;
+
+  for (unsigned n = 1; n <= max_threads; ++n) {
+    const double ops = 2.0 * burst * rounds * n;
+
+    concurrent_stack_pool<int> lock_free{burst * n};
+    const double t_lock_free = run(
+        n, [&lock_free](unsigned id) { lock_free_worker(lock_free, id); });
+
+    stack_pool<int, std::uint32_t> locked{burst * n};
+    std::mutex m;
+    const double t_locked =
+        run(n, [&locked, &m](unsigned id) { locked_worker(locked, m, id); });
+
+    std::cout << std::setw(8) << n << std::setw(20) << ops / t_lock_free * 1e-6
+              << std::setw(20) << ops / t_locked * 1e-6 << std::endl;
+  }
+}
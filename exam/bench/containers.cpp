@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <cstdlib>
+#include <forward_list>
+#include <iostream>
+#include <memory_resource>
+#include <random>
+#include <stack>
+#include <string>
+#include <vector>
+
+#include "../src/first_impl.hpp"
+#include "../stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  stack_pool against the standard containers one would use instead:
+  - pool: stack_pool, whose iterators hold the address of a node
+  - first_impl: the first implementation, whose iterators hold a pointer
+  - stack: std::stack<T, std::vector<T>>, one per stack
+  - forward_list: std::forward_list<T>, one per stack
+  - pmr_list: std::pmr::forward_list<T>, all the lists sharing an
+    unsynchronized_pool_resource
+  workloads, for n values:
+  - push: n pushes on an empty stack
+  - pop: n pops from a stack of n values
+  - iterate: read every value of a stack of n values
+  - free_stack: give back a whole stack of n values at once
+  - mixed: n random pushes (60%) and pops (40%) on 64 stacks
+  every workload is repeated (5 times, or argv[1]) on a new container;
+  the output is CSV, one line per container, value type, size and
+  workload, with the best, median and worst time per operation.
+  the sizes can be given after the repeats: containers.x 10 1000 1000000
+*/
+
+struct payload {
+  char data[64];
+  payload(std::size_t x) { std::fill(data, data + sizeof data, char(x)); }
+};
+
+template <typename T>
+T make(std::size_t i) {
+  return T(i);
+}
+template <>
+std::string make<std::string>(std::size_t i) {
+  return std::string(32, char('a' + i % 26));  // too long for the small string buffer
+}
+
+inline std::size_t checksum(int x) { return std::size_t(x); }
+inline std::size_t checksum(const payload& x) { return std::size_t(x.data[0]); }
+inline std::size_t checksum(const std::string& x) { return x.size(); }
+
+// stack_pool and first_impl::stack_pool share the same interface
+template <typename Pool, typename T>
+class pool_stacks {
+  Pool pool;
+  std::vector<std::size_t> heads;
+
+ public:
+  explicit pool_stacks(std::size_t n_stacks)
+      : heads(n_stacks, pool.new_stack()) {}
+  void push(std::size_t s, const T& x) { heads[s] = pool.push(x, heads[s]); }
+  bool pop(std::size_t s) {
+    if (pool.empty(heads[s]))
+      return false;
+    heads[s] = pool.pop(heads[s]);
+    return true;
+  }
+  template <typename F>
+  void for_each(std::size_t s, F f) {
+    std::for_each(pool.begin(heads[s]), pool.end(heads[s]), f);
+  }
+  void free(std::size_t s) {
+    if (!pool.empty(heads[s]))
+      heads[s] = pool.free_stack(heads[s]);
+  }
+};
+
+template <typename T>
+using index_pool = pool_stacks<stack_pool<T>, T>;
+template <typename T>
+using pointer_pool = pool_stacks<first_impl::stack_pool<T>, T>;
+
+template <typename T>
+class vector_stacks {
+  // the underlying vector is protected in std::stack
+  struct stack : std::stack<T, std::vector<T>> {
+    using std::stack<T, std::vector<T>>::c;
+  };
+  std::vector<stack> stacks;
+
+ public:
+  explicit vector_stacks(std::size_t n_stacks) : stacks(n_stacks) {}
+  void push(std::size_t s, const T& x) { stacks[s].push(x); }
+  bool pop(std::size_t s) {
+    if (stacks[s].empty())
+      return false;
+    stacks[s].pop();
+    return true;
+  }
+  template <typename F>
+  void for_each(std::size_t s, F f) {
+    std::for_each(stacks[s].c.rbegin(), stacks[s].c.rend(), f);
+  }
+  void free(std::size_t s) { stacks[s].c.clear(); }
+};
+
+template <typename List>
+class list_stacks {
+  std::vector<List> lists;
+
+ public:
+  template <typename... Args>
+  explicit list_stacks(std::size_t n_stacks, const Args&... args)
+      : lists(n_stacks, List(args...)) {}
+  void push(std::size_t s, const typename List::value_type& x) {
+    lists[s].push_front(x);
+  }
+  bool pop(std::size_t s) {
+    if (lists[s].empty())
+      return false;
+    lists[s].pop_front();
+    return true;
+  }
+  template <typename F>
+  void for_each(std::size_t s, F f) {
+    std::for_each(lists[s].begin(), lists[s].end(), f);
+  }
+  void free(std::size_t s) { lists[s].clear(); }
+};
+
+template <typename T>
+using std_lists = list_stacks<std::forward_list<T>>;
+
+template <typename T>
+class pmr_lists {
+  std::pmr::unsynchronized_pool_resource resource;  // outlives the lists
+  list_stacks<std::pmr::forward_list<T>> lists;
+
+ public:
+  explicit pmr_lists(std::size_t n_stacks)
+      : lists(n_stacks, std::pmr::polymorphic_allocator<T>{&resource}) {}
+  void push(std::size_t s, const T& x) { lists.push(s, x); }
+  bool pop(std::size_t s) { return lists.pop(s); }
+  template <typename F>
+  void for_each(std::size_t s, F f) {
+    lists.for_each(s, f);
+  }
+  void free(std::size_t s) { lists.free(s); }
+};
+
+template <typename Stacks, typename T>
+void fill(Stacks& stacks, const std::vector<T>& values) {
+  for (const auto& x : values)
+    stacks.push(0, x);
+}
+
+template <typename Stacks, typename T>
+double push(const std::vector<T>& values) {
+  Stacks stacks{1};
+  return seconds([&]() { fill(stacks, values); });
+}
+
+template <typename Stacks, typename T>
+double pop(const std::vector<T>& values) {
+  Stacks stacks{1};
+  fill(stacks, values);
+  return seconds([&]() {
+    while (stacks.pop(0))
+      ;
+  });
+}
+
+template <typename Stacks, typename T>
+double iterate(const std::vector<T>& values) {
+  Stacks stacks{1};
+  fill(stacks, values);
+  std::size_t sum = 0;
+  const double t = seconds(
+      [&]() { stacks.for_each(0, [&sum](const T& x) { sum += checksum(x); }); });
+  do_not_optimize(sum);
+  return t;
+}
+
+template <typename Stacks, typename T>
+double free_stack(const std::vector<T>& values) {
+  Stacks stacks{1};
+  fill(stacks, values);
+  return seconds([&]() { stacks.free(0); });
+}
+
+constexpr std::size_t mixed_stacks = 64;
+
+template <typename Stacks, typename T>
+double mixed(const std::vector<T>& values) {
+  std::mt19937 gen{42};
+  std::uniform_int_distribution<std::size_t> pick{0, mixed_stacks - 1};
+  std::bernoulli_distribution is_push{0.6};
+  std::vector<std::size_t> ops(values.size());  // stack + mixed_stacks * is_push
+  for (auto& op : ops)
+    op = pick(gen) + (is_push(gen) ? mixed_stacks : 0);
+
+  Stacks stacks{mixed_stacks};
+  return seconds([&]() {
+    for (std::size_t i = 0; i < ops.size(); ++i)
+      if (ops[i] >= mixed_stacks)
+        stacks.push(ops[i] - mixed_stacks, values[i]);
+      else
+        stacks.pop(ops[i]);
+  });
+}
+
+template <typename T>
+using workload = double (*)(const std::vector<T>&);
+
+template <typename Stacks, typename T>
+void run(const char* container,
+         const char* type_name,
+         std::size_t repeats,
+         const std::vector<T>& values) {
+  const std::pair<const char*, workload<T>> workloads[] = {
+      {"push", push<Stacks, T>},
+      {"pop", pop<Stacks, T>},
+      {"iterate", iterate<Stacks, T>},
+      {"free_stack", free_stack<Stacks, T>},
+      {"mixed", mixed<Stacks, T>}};
+  for (const auto& w : workloads) {
+    const auto times = repeat(repeats, [&]() { return w.second(values); });
+    const double per_op = 1e9 / values.size();
+    std::cout << container << ',' << type_name << ',' << values.size() << ','
+              << w.first << ',' << repeats << ',' << times.front() * per_op
+              << ',' << times[times.size() / 2] * per_op << ','
+              << times.back() * per_op << std::endl;
+  }
+}
+
+template <typename T>
+void all(const char* type_name,
+         std::size_t repeats,
+         const std::vector<std::size_t>& sizes) {
+  for (auto n : sizes) {
+    std::vector<T> values;
+    values.reserve(n);
+    for (std::size_t i = 0; i < n; ++i)
+      values.push_back(make<T>(i));
+    run<index_pool<T>>("pool", type_name, repeats, values);
+    run<pointer_pool<T>>("first_impl", type_name, repeats, values);
+    run<vector_stacks<T>>("stack", type_name, repeats, values);
+    run<std_lists<T>>("forward_list", type_name, repeats, values);
+    run<pmr_lists<T>>("pmr_list", type_name, repeats, values);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  const std::size_t repeats = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 5;
+  std::vector<std::size_t> sizes;
+  for (int i = 2; i < argc; ++i)
+    sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+  if (sizes.empty())
+    sizes = {1000, 100000, 1000000};
+
+  std::cout << "container,value_type,size,workload,repeats,best_ns,median_ns,"
+               "worst_ns"
+            << std::endl;
+  all<int>("int", repeats, sizes);
+  all<payload>("64 bytes", repeats, sizes);
+  all<std::string>("string", repeats, sizes);
+}
@@ -0,0 +1,50 @@
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+
+#include "../stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  a stack of n nodes is freed and rebuilt in a loop, once handled by its
+  head only (free_stack walks it to find the tail, its size needs
+  std::distance) and once through a stack descriptor.
+*/
+constexpr int reps = 10;
+
+void run(std::size_t n) {
+  stack_pool<int, std::size_t> pool{n};
+
+  auto l = pool.new_stack();
+  double t_size_head = 0, t_free_head = 0;
+  for (int r = 0; r < reps; ++r) {
+    for (std::size_t i = 0; i < n; ++i)
+      l = pool.push(int(i), l);
+    t_size_head += seconds(
+        [&]() { do_not_optimize(std::distance(pool.begin(l), pool.end(l))); });
+    t_free_head += seconds([&]() { l = pool.free_stack(l); });
+  }
+
+  auto d = pool.new_descriptor();
+  double t_size_desc = 0, t_free_desc = 0;
+  for (int r = 0; r < reps; ++r) {
+    for (std::size_t i = 0; i < n; ++i)
+      d = pool.push(int(i), d);
+    t_size_desc += seconds([&]() { do_not_optimize(pool.size(d)); });
+    t_free_desc += seconds([&]() { d = pool.free_stack(d); });
+  }
+
+  std::cout << std::setw(10) << n << std::setw(16) << t_size_head / reps * 1e6
+            << std::setw(16) << t_size_desc / reps * 1e6 << std::setw(16)
+            << t_free_head / reps * 1e6 << std::setw(16)
+            << t_free_desc / reps * 1e6 << std::endl;
+}
+
+int main() {
+  std::cout << std::setw(10) << "nodes" << std::setw(16) << "size head [us]"
+            << std::setw(16) << "size desc [us]" << std::setw(16)
+            << "free head [us]" << std::setw(16) << "free desc [us]"
+            << std::endl;
+  for (std::size_t n = 1000; n <= 1000000; n *= 10)
+    run(n);
+}
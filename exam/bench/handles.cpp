@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  the same workloads on pools with plain handles (std::size_t and
+  std::uint32_t) and with generational<std::uint32_t, 8> ones: n pushes
+  (1e7 by default, or argv[1]) on 64 stacks, a sum over every stack, n
+  random pops and pushes, then freeing all the stacks. the makefile
+  builds this file twice: handles.x with NDEBUG, where the checks are
+  compiled out and the generational pool should match the plain ones,
+  and handles_checked.x with the checks on, to see what they cost.
+*/
+constexpr std::size_t n_stacks = 64;
+
+template <typename N>
+void run(const std::string& name, std::size_t n) {
+  using pool_type = stack_pool<int, N>;
+  using stack_type = decltype(pool_type{}.new_stack());
+  // best of 5 repetitions for each phase
+  double t_push = 1e9, t_sum = 1e9, t_churn = 1e9, t_free = 1e9;
+  for (int r = 0; r < 5; ++r) {
+    pool_type pool{n};
+    std::vector<stack_type> heads(n_stacks, pool.new_stack());
+    std::mt19937 gen{42};
+    std::vector<std::uint32_t> which(n);
+    for (auto& w : which)
+      w = gen() % n_stacks;
+
+    const double push = seconds([&]() {
+      for (std::size_t i = 0; i < n; ++i)
+        heads[which[i]] = pool.push(int(i), heads[which[i]]);
+    });
+    const double sum = seconds([&]() {
+      long s = 0;
+      for (auto h : heads)
+        s = std::accumulate(pool.begin(h), pool.end(h), s);
+      do_not_optimize(s);
+    });
+    const double churn = seconds([&]() {
+      for (std::size_t i = 0; i < n; ++i) {
+        auto& h = heads[which[i]];
+        const int v = pool.value(h);
+        h = pool.push(v + 1, pool.pop(h));
+      }
+    });
+    const double free = seconds([&]() {
+      for (auto& h : heads)
+        h = pool.free_stack(h);
+    });
+    t_push = std::min(t_push, push);
+    t_sum = std::min(t_sum, sum);
+    t_churn = std::min(t_churn, churn);
+    t_free = std::min(t_free, free);
+  }
+  std::cout << std::setw(26) << name << std::setw(12) << t_push * 1e9 / n
+            << std::setw(12) << t_sum * 1e9 / n << std::setw(12)
+            << t_churn * 1e9 / n << std::setw(12) << t_free * 1e9 / n
+            << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  const std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+  std::cout << "checks " << (STACK_POOL_CHECK_HANDLES ? "on" : "off")
+            << ", times in ns per node" << std::endl;
+  std::cout << std::setw(26) << "handles" << std::setw(12) << "push"
+            << std::setw(12) << "sum" << std::setw(12) << "churn"
+            << std::setw(12) << "free" << std::endl;
+  run<std::size_t>("size_t", n);
+  run<std::uint32_t>("uint32_t", n);
+  run<generational<std::uint32_t, 8>>("generational<uint32_t,8>", n);
+}
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  n nodes are spread over s stacks, pushing on a random stack each
+  time: with many stacks consecutive nodes of a stack are far apart in
+  the pool, with one stack the traversal scans the pool backwards.
+  then we time, for both layouts:
+  - links: walking every stack with begin(x)/end(x) without reading values
+  - max: std::max_element on every stack
+  - free: free_stack on every stack
+*/
+template <std::size_t B>
+struct payload {
+  char data[B];
+  payload() = default;
+  payload(int x) { std::fill(data, data + B, char(x)); }
+  friend bool operator<(const payload& a, const payload& b) {
+    return a.data[0] < b.data[0];
+  }
+};
+
+constexpr std::size_t n_nodes = 1 << 20;
+
+template <typename T, typename Layout>
+void run(const std::string& type_name,
+         const std::string& layout_name,
+         std::size_t n_stacks) {
+  stack_pool<T, std::size_t, Layout> pool{n_nodes};
+  std::vector<std::size_t> heads(n_stacks, pool.new_stack());
+  std::mt19937 gen{42};
+  std::uniform_int_distribution<std::size_t> pick{0, n_stacks - 1};
+  for (std::size_t i = 0; i < n_nodes; ++i) {
+    auto& h = heads[pick(gen)];
+    h = pool.push(T(int(i)), h);
+  }
+
+  std::ptrdiff_t count = 0;
+  const double t_links = seconds([&]() {
+    for (auto h : heads)
+      count += std::distance(pool.begin(h), pool.end(h));
+  });
+  do_not_optimize(count);
+
+  const double t_max = seconds([&]() {
+    for (auto h : heads)
+      do_not_optimize(*std::max_element(pool.begin(h), pool.end(h)));
+  });
+
+  const double t_free = seconds([&]() {
+    for (auto& h : heads)
+      h = pool.free_stack(h);
+  });
+
+  std::cout << std::setw(12) << type_name << std::setw(8) << n_stacks
+            << std::setw(6) << layout_name
+            << std::setw(14) << t_links * 1e9 / n_nodes << std::setw(14)
+            << t_max * 1e9 / n_nodes << std::setw(14)
+            << t_free * 1e9 / n_nodes << std::endl;
+}
+
+template <typename T>
+void both(const std::string& type_name) {
+  for (std::size_t n_stacks : {1, 1 << 10}) {
+    run<T, aos_layout>(type_name, "aos", n_stacks);
+    run<T, soa_layout>(type_name, "soa", n_stacks);
+  }
+}
+
+int main() {
+  std::cout << std::setw(12) << "T" << std::setw(8) << "stacks"
+            << std::setw(6) << "" << std::setw(14)
+            << "links [ns]" << std::setw(14) << "max [ns]" << std::setw(14)
+            << "free [ns]" << "   (per node)" << std::endl;
+  both<char>("char");
+  both<int>("int");
+  both<double>("double");
+  both<payload<32>>("32 bytes");
+  both<payload<128>>("128 bytes");
+}
@@ -0,0 +1,118 @@
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../../c++/10_efficient_programming/count_operations/instrumented.hpp"
+#include "../src/first_impl.hpp"
+#include "../stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  what node reuse costs for values owning heap memory: n random pushes
+  (60%) and pops (40%) on 64 stacks (n = 1e6, or argv[1]), then every
+  stack is freed. the values are instrumented<std::string> (48 chars)
+  and instrumented<std::vector<int>> (16 ints), and we compare:
+  - first_impl: the first implementation, where a free node keeps its
+    old value and push assigns the new one over it
+  - push: stack_pool, where free nodes hold no value and push copies
+    the new value into the node
+  - emplace: stack_pool building the value in the node from a T
+  the columns are the operations on instrumented<T> per push, the time
+  per push or pop, and the heap in use (nodes and values) at the end of
+  the pushes and pops, and once every stack is freed.
+*/
+
+template <typename T>
+T payload(std::size_t i);
+
+template <>
+std::string payload<std::string>(std::size_t i) {
+  return std::string(48, char('a' + i % 26));
+}
+
+template <>
+std::vector<int> payload<std::vector<int>>(std::size_t i) {
+  return std::vector<int>(16, int(i));
+}
+
+constexpr std::size_t n_stacks = 64;
+
+template <typename Pool, typename T, typename Push>
+void run(const char* name, const char* type_name, std::size_t n, Push push) {
+  using value_type = instrumented<T>;
+  std::mt19937 gen{42};
+  std::uniform_int_distribution<std::size_t> pick{0, n_stacks - 1};
+  std::bernoulli_distribution is_push{0.6};
+  const std::vector<T> sources{payload<T>(0), payload<T>(1), payload<T>(2)};
+  const std::vector<value_type> values(sources.begin(), sources.end());
+
+  const std::size_t heap = heap_in_use();
+  std::size_t pushes = 0;
+  double t = 0;
+  double in_use = 0;
+  double retained = 0;
+  instrumented_base::initialize(0);
+  {
+    Pool pool{};
+    std::vector<std::size_t> heads(n_stacks, pool.new_stack());
+    t = seconds([&]() {
+      for (std::size_t i = 0; i < n; ++i) {
+        auto& h = heads[pick(gen)];
+        if (is_push(gen)) {
+          h = push(pool, h, values[i % 3], sources[i % 3]);
+          ++pushes;
+        } else if (!pool.empty(h)) {
+          h = pool.pop(h);
+        }
+      }
+    });
+    in_use = double(heap_in_use() - heap) / (1 << 20);
+    for (auto& h : heads)
+      if (!pool.empty(h))
+        h = pool.free_stack(h);
+    retained = double(heap_in_use() - heap) / (1 << 20);
+  }
+
+  const auto& c = instrumented_base::counts;
+  std::cout << std::setw(12) << type_name << std::setw(12) << name;
+  for (auto op : {instrumented_base::copy_ctor, instrumented_base::copy_assign,
+                  instrumented_base::move_ctor, instrumented_base::move_assign,
+                  instrumented_base::dtor})
+    std::cout << std::setw(12) << c[op] / pushes;
+  std::cout << std::setw(12) << t * 1e9 / n << std::setw(12) << in_use
+            << std::setw(12) << retained << std::endl;
+}
+
+template <typename T>
+void all(const char* type_name, std::size_t n) {
+  using value_type = instrumented<T>;
+  run<first_impl::stack_pool<value_type>, T>(
+      "first_impl", type_name, n,
+      [](auto& pool, std::size_t h, const value_type& x, const T&) {
+        return pool.push(x, h);
+      });
+  run<stack_pool<value_type>, T>(
+      "push", type_name, n,
+      [](auto& pool, std::size_t h, const value_type& x, const T&) {
+        return pool.push(x, h);
+      });
+  run<stack_pool<value_type>, T>(
+      "emplace", type_name, n,
+      [](auto& pool, std::size_t h, const value_type&, const T& x) {
+        return pool.emplace(h, x);
+      });
+}
+
+int main(int argc, char* argv[]) {
+  const std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+  std::cout << std::setw(12) << "T" << std::setw(12) << "" << std::setw(12)
+            << "copy ctor" << std::setw(12) << "copy assign" << std::setw(12)
+            << "move ctor" << std::setw(12) << "move assign" << std::setw(12)
+            << "dtor" << std::setw(12) << "ns per op" << std::setw(12)
+            << "heap [MiB]" << std::setw(12) << "after free" << std::endl;
+  all<std::string>("string", n);
+  all<std::vector<int>>("vector<int>", n);
+}
@@ -0,0 +1,166 @@
+#include <atomic>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../concurrent_stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  threads allocating and freeing nodes, going to the shared free list
+  for every node or through their own magazine, in two workloads:
+
+  - local: each thread repeatedly builds a stack of burst nodes and
+    frees it, so a node is freed by the thread that allocated it;
+  - handoff: threads work in pairs, a producer builds the stacks and
+    hands them to a consumer, which frees them, so every node is freed
+    by another thread and must cross the shared list to be reused.
+
+  each configuration runs twice: once with a plain pool, for the time,
+  and once with a pool counting its traffic (count_traffic), for the
+  nodes that went through the shared list and the compare-and-swaps
+  that moved them, per allocation.
+*/
+using stack_type = std::uint32_t;
+
+constexpr std::size_t burst = 256;
+constexpr std::size_t rounds = 1 << 12;
+
+// a single-producer, single-consumer ring of non-empty stacks
+class channel {
+  static constexpr std::size_t slots = 64;
+  std::atomic<stack_type> ring[slots];
+  std::size_t sent = 0;      // only touched by the producer
+  std::size_t received = 0;  // only touched by the consumer
+
+ public:
+  channel() {
+    for (auto& s : ring)
+      s.store(0, std::memory_order_relaxed);
+  }
+
+  void send(stack_type x) {
+    auto& s = ring[sent++ % slots];
+    while (s.load(std::memory_order_acquire) != 0)
+      std::this_thread::yield();
+    s.store(x, std::memory_order_release);
+  }
+
+  stack_type receive() {
+    auto& s = ring[received++ % slots];
+    stack_type x;
+    while ((x = s.load(std::memory_order_acquire)) == 0)
+      std::this_thread::yield();
+    s.store(0, std::memory_order_release);
+    return x;
+  }
+};
+
+/*
+  the magazine, if any, is passed along as the last argument of push
+  and pop: Mag is empty without magazines.
+*/
+template <typename Pool, typename... Mag>
+stack_type build(Pool& pool, unsigned id, Mag&... m) {
+  auto l = pool.new_stack();
+  for (std::size_t i = 0; i < burst; ++i)
+    l = pool.push(int(id + i), l, m...);
+  return l;
+}
+
+template <typename Pool, typename... Mag>
+void drop(Pool& pool, stack_type l, Mag&... m) {
+  while (!pool.empty(l))
+    l = pool.pop(l, m...);
+}
+
+template <typename Pool, typename... Mag>
+void local(Pool& pool, unsigned id, Mag&... m) {
+  for (std::size_t r = 0; r < rounds; ++r)
+    drop(pool, build(pool, id, m...), m...);
+}
+
+template <typename Pool, typename... Mag>
+void producer(Pool& pool, channel& c, unsigned id, Mag&... m) {
+  for (std::size_t r = 0; r < rounds; ++r)
+    c.send(build(pool, id, m...));
+}
+
+template <typename Pool, typename... Mag>
+void consumer(Pool& pool, channel& c, Mag&... m) {
+  for (std::size_t r = 0; r < rounds; ++r)
+    drop(pool, c.receive(), m...);
+}
+
+/*
+  run the workload on n threads (n pairs for the handoff), with
+  magazines of the given batch or without them (batch 0); return the
+  seconds taken.
+*/
+template <typename Pool>
+double run(Pool& pool, bool handoff, unsigned n, std::size_t batch) {
+  std::vector<channel> channels(handoff ? n : 0);
+  return seconds([&]() {
+    std::vector<std::thread> threads;
+    auto start = [&](unsigned id, int role) {
+      threads.emplace_back([&pool, &channels, id, role, batch]() {
+        if (batch == 0) {
+          if (role == 0)
+            local(pool, id);
+          else if (role == 1)
+            producer(pool, channels[id], id);
+          else
+            consumer(pool, channels[id]);
+        } else {
+          typename Pool::magazine m{pool, batch};
+          if (role == 0)
+            local(pool, id, m);
+          else if (role == 1)
+            producer(pool, channels[id], id, m);
+          else
+            consumer(pool, channels[id], m);
+        }
+      });
+    };
+    for (unsigned t = 0; t < n; ++t) {
+      start(t, handoff ? 1 : 0);
+      if (handoff)
+        start(t, 2);
+    }
+    for (auto& t : threads)
+      t.join();
+  });
+}
+
+void row(bool handoff, unsigned n, std::size_t batch) {
+  const double allocs = double(burst) * rounds * n;
+  concurrent_stack_pool<int, stack_type> plain{};
+  const double t = run(plain, handoff, n, batch);
+  concurrent_stack_pool<int, stack_type, count_traffic> counted{};
+  run(counted, handoff, n, batch);
+  std::cout << std::setw(10) << (handoff ? "handoff" : "local") << std::setw(8)
+            << (handoff ? 2 * n : n) << std::setw(8)
+            << (batch == 0 ? std::string("-") : std::to_string(batch)) << std::setw(14)
+            << allocs / t * 1e-6 << std::setw(14) << counted.traffic().shared_nodes() / allocs
+            << std::setw(14) << counted.traffic().shared_updates() / allocs << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  unsigned max_threads = std::thread::hardware_concurrency();
+  if (argc > 1)
+    max_threads = std::stoul(argv[1]);
+  if (max_threads == 0)
+    max_threads = 1;
+
+  std::cout << std::setw(10) << "workload" << std::setw(8) << "threads" << std::setw(8)
+            << "batch" << std::setw(14) << "[Malloc/s]" << std::setw(14) << "nodes/alloc"
+            << std::setw(14) << "CAS/alloc" << std::endl;
+
+  for (bool handoff : {false, true})
+    for (unsigned n = 1; n <= (handoff ? (max_threads + 1) / 2 : max_threads); ++n)
+      for (std::size_t batch : {0, 8, 32, 128})
+        row(handoff, n, batch);
+}
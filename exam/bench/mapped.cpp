@@ -0,0 +1,53 @@
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "../mapped_stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  build a pool of n nodes in a file, then measure how long it takes to
+  open it again and read the top of the stack stored in the first root,
+  compared with building the same stack from scratch in memory.
+*/
+using pool_type = mapped_stack_pool<long, std::uint64_t>;
+
+int main() {
+  const std::string path{"bench_mapped.pool"};
+  std::cout << std::setw(10) << "nodes" << std::setw(18) << "rebuild [ms]"
+            << std::setw(18) << "file build [ms]" << std::setw(18)
+            << "warm start [ms]" << std::endl;
+
+  for (std::size_t n = 100000; n <= 10000000; n *= 10) {
+    std::remove(path.c_str());
+
+    const double t_rebuild = seconds([n]() {
+      stack_pool<long, std::uint64_t> pool{};
+      auto l = pool.new_stack();
+      for (std::size_t i = 0; i < n; ++i)
+        l = pool.push(long(i), l);
+      do_not_optimize(pool.value(l));
+    });
+
+    const double t_build = seconds([n, &path]() {
+      pool_type pool{path};
+      pool.reserve(n);
+      auto l = pool.new_stack();
+      for (std::size_t i = 0; i < n; ++i)
+        l = pool.push(long(i), l);
+      pool.root(0) = l;
+      pool.sync();
+    });
+
+    const double t_warm = seconds([&path]() {
+      pool_type pool{path};
+      do_not_optimize(pool.value(pool.root(0)));
+    });
+
+    std::cout << std::setw(10) << n << std::setw(18) << t_rebuild * 1e3
+              << std::setw(18) << t_build * 1e3 << std::setw(18)
+              << t_warm * 1e3 << std::endl;
+  }
+  std::remove(path.c_str());
+}
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../parallel_stacks.hpp"
+#include "../stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  50000 stacks holding 1e7 values in all, with lengths drawn from a
+  pareto distribution (a few stacks hold most of the values). the sum of
+  every stack is computed with transform_reduce_stacks, and with a
+  static split of the stacks in one contiguous block per thread as
+  baseline. the stacks are either shuffled or sorted by length, the
+  worst case for the static split since the first block gets all the
+  long stacks. the threads go from 1 to the number of cores, or argv[1].
+*/
+constexpr std::size_t n_stacks = 50000;
+constexpr std::size_t n_values = 10000000;
+
+using pool_type = stack_pool<int, std::uint32_t>;
+
+std::vector<long> static_split(const pool_type& pool,
+                               const std::vector<std::uint32_t>& heads,
+                               unsigned n_threads) {
+  std::vector<long> sums(heads.size());
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < n_threads; ++t)
+    threads.emplace_back([&, t]() {
+      const std::size_t first = heads.size() * t / n_threads;
+      const std::size_t last = heads.size() * (t + 1) / n_threads;
+      for (std::size_t i = first; i < last; ++i) {
+        long s = 0;
+        for (auto it = pool.begin(heads[i]); it != pool.end(heads[i]); ++it)
+          s += *it;
+        sums[i] = s;
+      }
+    });
+  for (auto& t : threads)
+    t.join();
+  return sums;
+}
+
+void run(const pool_type& pool, const std::vector<std::uint32_t>& heads,
+         const std::string& order, unsigned max_threads) {
+  for (unsigned n = 1; n <= max_threads; ++n) {
+    stack_workers workers{n};
+    double t_stealing = 1e9, t_static = 1e9;
+    for (int r = 0; r < 3; ++r) {
+      t_stealing = std::min(t_stealing, seconds([&]() {
+        do_not_optimize(transform_reduce_stacks(workers, pool, heads, 0L,
+                                                std::plus<long>{},
+                                                [](int x) { return long(x); }));
+      }));
+      t_static = std::min(t_static, seconds([&]() {
+        do_not_optimize(static_split(pool, heads, n));
+      }));
+    }
+    std::cout << std::setw(10) << order << std::setw(9) << n << std::setw(16)
+              << t_stealing * 1e3 << std::setw(14) << t_static * 1e3
+              << std::endl;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  unsigned max_threads = std::thread::hardware_concurrency();
+  if (argc > 1)
+    max_threads = std::stoul(argv[1]);
+  if (max_threads == 0)
+    max_threads = 1;
+
+  // pareto lengths with shape 1.1, scaled to n_values in all
+  std::mt19937 gen{42};
+  std::uniform_real_distribution<double> u{0.0, 1.0};
+  std::vector<double> weights(n_stacks);
+  for (auto& w : weights)
+    w = std::pow(1.0 - u(gen), -1.0 / 1.1);
+  double total = 0;
+  for (auto w : weights)
+    total += w;
+  std::vector<std::size_t> lengths(n_stacks);
+  for (std::size_t s = 0; s < n_stacks; ++s)
+    lengths[s] = std::size_t(weights[s] / total * n_values);
+
+  // push the values round robin, so that the stacks are interleaved
+  pool_type pool{n_values};
+  std::vector<std::uint32_t> heads(n_stacks, pool.new_stack());
+  std::vector<std::size_t> left = lengths;
+  for (bool pushed = true; pushed;) {
+    pushed = false;
+    for (std::size_t s = 0; s < n_stacks; ++s)
+      if (left[s] > 0) {
+        heads[s] = pool.push(int(--left[s]), heads[s]);
+        pushed = true;
+      }
+  }
+
+  std::cout << "longest stack " << *std::max_element(lengths.begin(), lengths.end())
+            << " values" << std::endl;
+  std::cout << std::setw(10) << "stacks" << std::setw(9) << "threads"
+            << std::setw(16) << "stealing [ms]" << std::setw(14)
+            << "static [ms]" << std::endl;
+  std::vector<std::pair<std::size_t, std::uint32_t>> by_length(n_stacks);
+  for (std::size_t s = 0; s < n_stacks; ++s)
+    by_length[s] = {lengths[s], heads[s]};
+
+  std::shuffle(heads.begin(), heads.end(), gen);
+  run(pool, heads, "shuffled", max_threads);
+
+  std::sort(by_length.begin(), by_length.end(),
+            std::greater<std::pair<std::size_t, std::uint32_t>>{});
+  for (std::size_t s = 0; s < n_stacks; ++s)
+    heads[s] = by_length[s].second;
+  run(pool, heads, "sorted", max_threads);
+}
@@ -0,0 +1,105 @@
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "../persistent_stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  the partial solutions of a breadth-first search: every solution of
+  depth d - 1 has 4 children, one more choice each, so depth d holds
+  4^d solutions of d ints (d up to 10 by default, or argv[1]). the
+  solutions of a level are built from those of the level above, which
+  are then dropped.
+
+  a solution is a std::vector copied from its parent, or a stack of a
+  persistent_stack_pool pushed on a reference to its parent, so that
+  siblings share all the nodes but the top one. the columns are the
+  nanoseconds per solution to build a level and to walk all of it (the
+  sum of every solution), and the heap in use once it is built.
+*/
+constexpr int branching = 4;
+
+struct result {
+  double build;
+  double walk;
+  std::size_t bytes;
+};
+
+result vectors(int depth) {
+  const auto heap = heap_in_use();
+  std::vector<std::vector<int>> level{{}};
+  double build = 0;
+  for (int d = 0; d < depth; ++d)
+    build = seconds([&]() {
+      std::vector<std::vector<int>> children;
+      children.reserve(level.size() * branching);
+      for (const auto& s : level)
+        for (int c = 0; c < branching; ++c) {
+          children.push_back(s);
+          children.back().push_back(c);
+        }
+      level.swap(children);
+    });
+  const std::size_t bytes = heap_in_use() - heap;
+  const double walk = seconds([&]() {
+    long sum = 0;
+    for (const auto& s : level)
+      for (auto x : s)
+        sum += x;
+    do_not_optimize(sum);
+  });
+  return {build, walk, bytes};
+}
+
+result persistent(int depth) {
+  const auto heap = heap_in_use();
+  persistent_stack_pool<int, std::uint32_t> pool{};
+  std::vector<std::uint32_t> level{pool.new_stack()};
+  double build = 0;
+  for (int d = 0; d < depth; ++d)
+    build = seconds([&]() {
+      std::vector<std::uint32_t> children;
+      children.reserve(level.size() * branching);
+      for (auto s : level) {
+        for (int c = 0; c < branching; ++c)
+          children.push_back(pool.push(c, pool.share(s)));
+        pool.free_stack(s);
+      }
+      level.swap(children);
+    });
+  const std::size_t bytes = heap_in_use() - heap;
+  const double walk = seconds([&]() {
+    long sum = 0;
+    for (auto s : level)
+      for (auto it = pool.begin(s); it != pool.end(s); ++it)
+        sum += *it;
+    do_not_optimize(sum);
+  });
+  return {build, walk, bytes};
+}
+
+int main(int argc, char* argv[]) {
+  const int max_depth = argc > 1 ? std::atoi(argv[1]) : 10;
+  std::cout << std::setw(6) << "depth" << std::setw(12) << "solutions" << std::setw(24)
+            << "build [ns]" << std::setw(24) << "walk [ns]" << std::setw(24) << "heap [MB]"
+            << std::endl
+            << std::setw(18) << "";
+  for (int i = 0; i < 3; ++i)
+    std::cout << std::setw(12) << "vector" << std::setw(12) << "persistent";
+  std::cout << std::endl;
+
+  for (int depth = 4; depth <= max_depth; depth += 2) {
+    std::size_t n = 1;
+    for (int d = 0; d < depth; ++d)
+      n *= branching;
+    const auto v = vectors(depth);
+    const auto p = persistent(depth);
+    std::cout << std::setw(6) << depth << std::setw(12) << n << std::setw(12)
+              << v.build * 1e9 / double(n) << std::setw(12) << p.build * 1e9 / double(n) << std::setw(12)
+              << v.walk * 1e9 / double(n) << std::setw(12) << p.walk * 1e9 / double(n) << std::setw(12)
+              << v.bytes / 1e6 << std::setw(12) << p.bytes / 1e6 << std::endl;
+  }
+}
@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory_resource>
+#include <numeric>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "../../c++/10_efficient_programming/count_operations/instrumented.hpp"
+#include "../pool_memory_resource.hpp"
+#include "bench.hpp"
+
+/*
+  the std::set workload of test_count_operations.cpp: n instrumented
+  ints from -1024 on, shuffled, a std::set built from them and then
+  destroyed, for n = 2^10 ... 2^22 (or up to argv[1]). as there, the
+  values are cut to 8 bits ("& 255", at most 256 nodes, so almost no
+  allocation), and also kept whole ("distinct", one node per value).
+
+  the set allocates with std::allocator ("default"), or is a
+  std::pmr::set on std::pmr::unsynchronized_pool_resource or on a
+  pool_memory_resource. the columns are the nanoseconds per value to
+  build and destroy the set and, for distinct values, to walk it once
+  built (the nodes are allocated in the order of the shuffled values,
+  not in the order of the set).
+*/
+using value_type = instrumented<int>;
+
+// libstdc++: color, parent, left and right, then the value
+constexpr std::size_t node_size = 4 * sizeof(void*) + sizeof(value_type);
+
+struct timings {
+  double build = 1e9;
+  double walk = 1e9;
+};
+
+template <typename Set, typename... Resource>
+timings run(const std::vector<value_type>& v, Resource&... resource) {
+  timings t;
+  for (int r = 0; r < 3; ++r) {
+    long sum = 0;
+    double walk = 0;
+    const double build = seconds([&]() {
+      Set set{v.begin(), v.end(), std::less<value_type>{}, &resource...};
+      walk = seconds([&]() {
+        for (const auto& x : set)
+          sum += int(x);
+      });
+    });
+    do_not_optimize(sum);
+    t.build = std::min(t.build, build - walk);
+    t.walk = std::min(t.walk, walk);
+  }
+  return t;
+}
+
+void row(const char* workload, const std::vector<value_type>& v, bool walk) {
+  using pmr_set = std::pmr::set<value_type>;
+  const double n = v.size();
+
+  const auto d = run<std::set<value_type>>(v);
+  std::pmr::unsynchronized_pool_resource std_pool;
+  const auto u = run<pmr_set>(v, std_pool);
+  pool_memory_resource pool{node_size};
+  const auto p = run<pmr_set>(v, pool);
+
+  std::cout << std::setw(10) << workload << std::setw(10) << v.size();
+  for (const auto& t : {d, u, p})
+    std::cout << std::setw(12) << t.build * 1e9 / n;
+  if (walk)
+    for (const auto& t : {d, u, p})
+      std::cout << std::setw(12) << t.walk * 1e9 / n;
+  std::cout << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  const std::size_t max_n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : (1 << 22);
+  std::cout << std::setw(20) << "" << std::setw(36) << "build and destroy [ns]"
+            << std::setw(36) << "walk [ns]" << std::endl
+            << std::setw(10) << "values" << std::setw(10) << "n";
+  for (int i = 0; i < 2; ++i)
+    std::cout << std::setw(12) << "default" << std::setw(12) << "std::pmr"
+              << std::setw(12) << "pool";
+  std::cout << std::endl;
+
+  std::mt19937 gen{42};
+  for (std::size_t n = 1 << 10; n <= max_n; n <<= 2) {
+    std::vector<value_type> v(n, value_type{0});
+    std::iota(v.begin(), v.end(), value_type(-1024));
+    std::shuffle(v.begin(), v.end(), gen);
+    row("distinct", v, true);
+    for (auto& x : v)
+      x = int(x) & 255;
+    row("& 255", v, false);
+  }
+}
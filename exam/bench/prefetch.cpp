@@ -0,0 +1,63 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  a single stack of n nodes (1e7 by default, or argv[1]) whose links
+  visit the pool in random order, so that every step of a traversal is
+  a cache miss. we time std::max_element over the plain iterators and
+  over the prefetching ones, for a few distances and both layouts.
+*/
+template <typename Layout, std::size_t Distance>
+void prefetched(const stack_pool<int, std::size_t, Layout>& pool,
+                std::size_t head, std::size_t n) {
+  const double t = seconds([&]() {
+    do_not_optimize(*std::max_element(pool.template prefetch_begin<Distance>(head),
+                                      pool.template prefetch_end<Distance>(head)));
+  });
+  std::cout << std::setw(12) << Distance << std::setw(14) << t * 1e9 / n
+            << std::endl;
+}
+
+template <typename Layout>
+void run(const std::string& layout_name, std::size_t n) {
+  stack_pool<int, std::size_t, Layout> pool{n};
+  std::vector<std::size_t> order(n);
+  std::mt19937 gen{42};
+  std::uniform_int_distribution<int> value{0, 1 << 30};
+  for (auto& x : order)
+    x = pool.push(value(gen), pool.new_stack());
+  std::shuffle(order.begin(), order.end(), gen);
+  for (std::size_t i = 0; i + 1 < n; ++i)
+    pool.next(order[i]) = order[i + 1];
+  const std::size_t head = order.front();
+
+  std::cout << layout_name << std::endl;
+  const auto& cpool = pool;
+  const double t = seconds([&]() {
+    do_not_optimize(*std::max_element(cpool.begin(head), cpool.end(head)));
+  });
+  std::cout << std::setw(12) << "plain" << std::setw(14) << t * 1e9 / n
+            << std::endl;
+  prefetched<Layout, 1>(cpool, head, n);
+  prefetched<Layout, 2>(cpool, head, n);
+  prefetched<Layout, 4>(cpool, head, n);
+  prefetched<Layout, 8>(cpool, head, n);
+  prefetched<Layout, 16>(cpool, head, n);
+}
+
+int main(int argc, char* argv[]) {
+  const std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+  std::cout << std::setw(12) << "distance" << std::setw(14) << "max [ns]"
+            << "   (per node)" << std::endl;
+  run<aos_layout>("aos", n);
+  run<soa_layout>("soa", n);
+}
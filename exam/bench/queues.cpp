@@ -0,0 +1,141 @@
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../queue_pool.hpp"
+#include "bench.hpp"
+
+/*
+  many small queues of ints: 10000 queues (or argv[2]) take n operations
+  (1e7 by default, or argv[1]) at random, three enqueues for every
+  dequeue, so that each queue holds about 500 values at the end. we
+  compare std::queue (on std::deque, which allocates a block of 512
+  bytes per queue as soon as it holds a value) with queue_pool and
+  deque_pool (32 bit addresses) on the time per operation, the heap
+  used per value at the end, and the time per value to sum every queue.
+*/
+// std::queue hides its container, which we need to walk the values
+struct iterable_queue : std::queue<int> {
+  using std::queue<int>::c;
+};
+
+struct std_queues {
+  using queue_type = iterable_queue;
+  std::vector<queue_type> queues;
+
+  explicit std_queues(std::size_t n) : queues(n) {}
+  void enqueue(std::size_t k, int v) { queues[k].push(v); }
+  void dequeue(std::size_t k) {
+    if (!queues[k].empty())
+      queues[k].pop();
+  }
+  long sum() const {
+    long s = 0;
+    for (const auto& q : queues)
+      for (auto it = q.c.cbegin(); it != q.c.cend(); ++it)
+        s += *it;
+    return s;
+  }
+  std::size_t size() const {
+    std::size_t n = 0;
+    for (const auto& q : queues)
+      n += q.size();
+    return n;
+  }
+  std::size_t extra() const { return queues.size() * sizeof(queue_type); }
+};
+
+struct pooled_queues {
+  using pool_type = queue_pool<int, std::uint32_t>;
+  pool_type pool;
+  std::vector<pool_type::queue_type> queues;
+
+  explicit pooled_queues(std::size_t n) : queues(n, pool.new_queue()) {}
+  void enqueue(std::size_t k, int v) { queues[k] = pool.enqueue(v, queues[k]); }
+  void dequeue(std::size_t k) { queues[k] = pool.dequeue(queues[k]); }
+  long sum() const {
+    long s = 0;
+    for (const auto& q : queues)
+      for (auto it = pool.cbegin(q); it != pool.cend(q); ++it)
+        s += *it;
+    return s;
+  }
+  std::size_t size() const {
+    std::size_t n = 0;
+    for (const auto& q : queues)
+      n += pool.size(q);
+    return n;
+  }
+  std::size_t extra() const { return queues.size() * sizeof(pool_type::queue_type); }
+};
+
+struct pooled_deques {
+  using pool_type = deque_pool<int, std::uint32_t>;
+  pool_type pool;
+  std::vector<pool_type::deque_type> queues;
+
+  explicit pooled_deques(std::size_t n) : queues(n, pool.new_deque()) {}
+  void enqueue(std::size_t k, int v) { queues[k] = pool.push_back(v, queues[k]); }
+  void dequeue(std::size_t k) { queues[k] = pool.pop_front(queues[k]); }
+  long sum() const {
+    long s = 0;
+    for (const auto& q : queues)
+      for (auto it = pool.cbegin(q); it != pool.cend(q); ++it)
+        s += *it;
+    return s;
+  }
+  std::size_t size() const {
+    std::size_t n = 0;
+    for (const auto& q : queues)
+      n += pool.size(q);
+    return n;
+  }
+  std::size_t extra() const { return queues.size() * sizeof(pool_type::deque_type); }
+};
+
+template <typename Queues>
+void run(const std::string& name, std::size_t n, std::size_t n_queues) {
+  std::vector<std::uint32_t> which(n);
+  std::mt19937 gen{42};
+  for (auto& w : which)
+    w = gen();  // the low bits choose the queue, the high ones the operation
+
+  double t_ops = 1e9, t_sum = 1e9, bytes = 0;
+  long check = 0;
+  for (int r = 0; r < 3; ++r) {
+    const std::size_t heap = heap_in_use();
+    Queues queues{n_queues};
+    t_ops = std::min(t_ops, seconds([&]() {
+      for (std::size_t i = 0; i < n; ++i) {
+        const std::size_t k = which[i] % n_queues;
+        if (which[i] >> 30 != 0)
+          queues.enqueue(k, int(i));
+        else
+          queues.dequeue(k);
+      }
+    }));
+    bytes = double(heap_in_use() - heap - queues.extra()) / queues.size();
+    t_sum = std::min(t_sum, seconds([&]() { check = queues.sum(); }));
+    do_not_optimize(check);
+  }
+  std::cout << std::setw(12) << name << std::setw(14) << t_ops * 1e9 / n
+            << std::setw(14) << bytes << std::setw(12) << t_sum * 1e9 / n
+            << std::setw(20) << check << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  const std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+  const std::size_t n_queues = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10000;
+  std::cout << std::setw(12) << "queues" << std::setw(14) << "op [ns]"
+            << std::setw(14) << "bytes/value" << std::setw(12) << "sum [ns]"
+            << std::setw(20) << "checksum" << std::endl;
+  run<std_queues>("std::queue", n, n_queues);
+  run<pooled_queues>("queue_pool", n, n_queues);
+  run<pooled_deques>("deque_pool", n, n_queues);
+}
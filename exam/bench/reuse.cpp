@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  the reuse policies of stack_pool after a long churn: 1000 stacks are
+  filled with 4e6 ints at random, then take n random pushes and pops
+  (1e7 by default, or argv[1]), half and half, so that the free nodes
+  end up scattered all over the pool. we time the churn, then a walk of
+  every stack (the sum of its values), and the same walk once every
+  stack is freed and pushed again, one stack after the other: with
+  lifo_reuse the new nodes come back in the order they were freed, with
+  the other policies in order of address. the last column is the mean
+  distance, in nodes, from a node to the one below it.
+*/
+constexpr std::size_t n_stacks = 1000;
+constexpr std::size_t n_values = 4000000;
+
+using value_type = int;
+
+template <typename Pool>
+double walk(const Pool& pool, const std::vector<std::uint32_t>& heads) {
+  return repeat(3, [&]() {
+           return seconds([&]() {
+             long s = 0;
+             for (auto h : heads)
+               s = std::accumulate(pool.begin(h), pool.end(h), s);
+             do_not_optimize(s);
+           });
+         })
+      .front();
+}
+
+template <typename Pool>
+double distance(const Pool& pool, const std::vector<std::uint32_t>& heads) {
+  double total = 0;
+  std::size_t n = 0;
+  for (auto h : heads)
+    for (auto x = h; !pool.empty(x) && !pool.empty(pool.next(x)); x = pool.next(x), ++n)
+      total += std::abs(double(x) - double(pool.next(x)));
+  return total / n;
+}
+
+template <typename Reuse>
+void run(const std::string& name, std::size_t n) {
+  using pool_type = stack_pool<value_type, std::uint32_t, aos_layout, std::allocator<value_type>, no_stats, Reuse>;
+  pool_type pool{};
+  std::vector<std::uint32_t> heads(n_stacks, pool.new_stack());
+  std::mt19937 gen{42};
+  for (std::size_t i = 0; i < n_values; ++i) {
+    auto& h = heads[gen() % n_stacks];
+    h = pool.push(value_type(i), h);
+  }
+  std::vector<std::uint32_t> which(n);
+  for (auto& w : which)
+    w = gen();
+
+  const double t_churn = seconds([&]() {
+    for (std::size_t i = 0; i < n; ++i) {
+      auto& h = heads[which[i] % n_stacks];
+      if (which[i] >> 31)
+        h = pool.push(value_type(i), h);
+      else
+        h = pool.pop(h);
+    }
+  });
+  std::size_t live = 0;
+  for (auto h : heads)
+    live += std::distance(pool.begin(h), pool.end(h));
+  const double t_walk = walk(pool, heads);
+  const double d_walk = distance(pool, heads);
+
+  // free every stack, then push as many values again, one stack at a time
+  std::vector<std::size_t> lengths;
+  for (auto& h : heads) {
+    lengths.push_back(std::distance(pool.begin(h), pool.end(h)));
+    if (!pool.empty(h))
+      h = pool.free_stack(h);
+  }
+  for (std::size_t k = 0; k < n_stacks; ++k)
+    for (std::size_t i = 0; i < lengths[k]; ++i)
+      heads[k] = pool.push(value_type(i), heads[k]);
+  const double t_rebuilt = walk(pool, heads);
+  const double d_rebuilt = distance(pool, heads);
+
+  std::cout << std::setw(14) << name << std::setw(12) << t_churn * 1e9 / n
+            << std::setw(12) << t_walk * 1e9 / live << std::setw(12) << d_walk
+            << std::setw(12) << t_rebuilt * 1e9 / live << std::setw(12) << d_rebuilt
+            << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  const std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+  std::cout << std::setw(14) << "policy" << std::setw(12) << "op [ns]"
+            << std::setw(12) << "walk [ns]" << std::setw(12) << "distance"
+            << std::setw(12) << "rebuilt" << std::setw(12) << "distance" << std::endl;
+  run<lifo_reuse>("lifo", n);
+  run<lowest_address_reuse>("lowest address", n);
+  run<nearest_head_reuse>("nearest head", n);
+}
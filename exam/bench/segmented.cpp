@@ -0,0 +1,70 @@
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  push n values (1e8 by default, or the first argument) on one stack
+  timing every single push, with the nodes stored in one std::vector
+  and in chunks. latencies are collected in power of two buckets: the
+  percentiles printed are upper bounds, the maximum is exact.
+*/
+struct histogram {
+  std::vector<std::size_t> buckets = std::vector<std::size_t>(64, 0);
+  std::size_t count = 0;
+  double max = 0;
+
+  void add(double ns) {
+    std::size_t b = 0;
+    while (b < 63 && double(std::size_t(1) << b) < ns)
+      ++b;
+    ++buckets[b];
+    ++count;
+    if (ns > max)
+      max = ns;
+  }
+
+  double percentile(double p) const {
+    const double target = p * count;
+    double seen = 0;
+    for (std::size_t b = 0; b < buckets.size(); ++b) {
+      seen += buckets[b];
+      if (seen >= target)
+        return double(std::size_t(1) << b);
+    }
+    return max;
+  }
+};
+
+template <typename Layout>
+void run(const std::string& name, std::size_t n) {
+  stack_pool<int, std::uint32_t, Layout> pool{};
+  auto l = pool.new_stack();
+  histogram h;
+  double total = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    const double t = seconds([&]() { l = pool.push(int(i), l); });
+    h.add(t * 1e9);
+    total += t;
+  }
+  std::cout << std::setw(12) << name << std::setw(12) << total * 1e9 / n
+            << std::setw(12) << h.percentile(0.5) << std::setw(12)
+            << h.percentile(0.99) << std::setw(12) << h.percentile(0.9999)
+            << std::setw(16) << h.max << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  const std::size_t n =
+      argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000000;
+  std::cout << "push latency [ns] over " << n << " pushes" << std::endl;
+  std::cout << std::setw(12) << "storage" << std::setw(12) << "mean"
+            << std::setw(12) << "p50 <=" << std::setw(12) << "p99 <="
+            << std::setw(12) << "p99.99 <=" << std::setw(16) << "max"
+            << std::endl;
+  run<aos_layout>("vector", n);
+  run<segmented_layout<16>>("chunks 2^16", n);
+}
@@ -0,0 +1,63 @@
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  a pool of n ints is written to memory streams with print_stack (one
+  stack after the other, as text), with save and with save using
+  compressed links, then read back with load. the stacks are either
+  built one after the other or pushing on a random stack each time.
+*/
+using pool_type = stack_pool<int, std::uint32_t>;
+
+constexpr std::size_t n = 1 << 22;
+constexpr std::size_t n_stacks = 1 << 10;
+
+void run(const std::string& name, bool scattered) {
+  pool_type pool{n};
+  std::vector<std::uint32_t> heads(n_stacks, pool.new_stack());
+  std::mt19937 gen{1};
+  std::uniform_int_distribution<std::size_t> pick{0, n_stacks - 1};
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto s = scattered ? pick(gen) : i * n_stacks / n;
+    heads[s] = pool.push(int(gen()), heads[s]);
+  }
+
+  std::ostringstream text;
+  auto* old = std::cout.rdbuf(text.rdbuf());
+  const double t_print = seconds([&]() {
+    for (auto h : heads)
+      pool.print_stack(h);
+  });
+  std::cout.rdbuf(old);
+
+  for (bool compress : {false, true}) {
+    std::stringstream image;
+    const double t_save =
+        seconds([&]() { pool.save(image, heads, compress); });
+    pool_type copy{};
+    const double t_load = seconds([&]() { copy.load(image); });
+
+    std::cout << std::setw(10) << name << std::setw(10)
+              << (compress ? "varint" : "raw") << std::setw(14)
+              << image.str().size() / 1e6 << std::setw(14) << t_save * 1e3
+              << std::setw(14) << t_load * 1e3 << std::setw(14)
+              << text.str().size() / 1e6 << std::setw(14) << t_print * 1e3
+              << std::endl;
+  }
+}
+
+int main() {
+  std::cout << std::setw(10) << "stacks" << std::setw(10) << "links"
+            << std::setw(14) << "image [MB]" << std::setw(14) << "save [ms]"
+            << std::setw(14) << "load [ms]" << std::setw(14) << "text [MB]"
+            << std::setw(14) << "print [ms]" << std::endl;
+  run("ordered", false);
+  run("scattered", true);
+}
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  a stack of n random keys is sorted in two ways: with sort(), which
+  only relinks the nodes, and by copying the values out through the
+  iterators, std::sort-ing them and pushing them back on the freed
+  nodes. the payload of each value is Bytes bytes (the key included).
+  the nodes of the stack are pushed in order ("sequential") or with
+  the stack interleaved with another one that is then freed
+  ("scattered"), so that following the links jumps around the pool.
+  n is 1e7 for the small values and less for the large ones (about
+  256 MB of values), unless given as argv[1].
+*/
+template <std::size_t Bytes>
+struct record {
+  std::uint64_t key;
+  char payload[Bytes - sizeof(std::uint64_t)];
+};
+
+struct by_key {
+  template <typename R>
+  bool operator()(const R& a, const R& b) const noexcept {
+    return a.key < b.key;
+  }
+};
+
+template <std::size_t Bytes>
+void run(std::size_t n, bool scattered) {
+  using T = record<Bytes>;
+  using pool_type = stack_pool<T, std::uint32_t>;
+  double t_relink = 1e9, t_copy = 1e9;
+  for (int r = 0; r < 3; ++r) {
+    for (int copy = 0; copy < 2; ++copy) {
+      pool_type pool{scattered ? 2 * n : n};
+      std::mt19937_64 gen{42};
+      T x{};
+      auto l = pool.new_stack();
+      auto other = pool.new_stack();
+      for (std::size_t i = 0; i < n; ++i) {
+        x.key = gen();
+        l = pool.push(x, l);
+        if (scattered)
+          other = pool.push(x, other);
+      }
+      if (scattered)
+        other = pool.free_stack(other);
+
+      const double t = seconds([&]() {
+        if (copy) {
+          std::vector<T> v(pool.begin(l), pool.end(l));
+          std::sort(v.begin(), v.end(), by_key{});
+          l = pool.free_stack(l);
+          l = pool.push_range(v.rbegin(), v.rend(), l);
+        } else {
+          l = pool.sort(l, by_key{});
+        }
+      });
+      do_not_optimize(pool.value(l).key);
+      (copy ? t_copy : t_relink) = std::min(copy ? t_copy : t_relink, t);
+    }
+  }
+  std::cout << std::setw(8) << Bytes << std::setw(11) << n << std::setw(12)
+            << (scattered ? "scattered" : "sequential") << std::setw(14)
+            << t_relink * 1e3 << std::setw(14) << t_copy * 1e3 << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  const std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 0;
+  std::cout << std::setw(8) << "bytes" << std::setw(11) << "nodes"
+            << std::setw(12) << "stack" << std::setw(14) << "sort() [ms]"
+            << std::setw(14) << "copy [ms]" << std::endl;
+  for (bool scattered : {false, true}) {
+    run<8>(n ? n : 10000000, scattered);
+    run<64>(n ? n : 10000000, scattered);
+    run<256>(n ? n : 1000000, scattered);
+    run<1024>(n ? n : 250000, scattered);
+  }
+}
@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  n values (1e7 by default, or argv[1]) pushed at random on 1000 stacks,
+  then a tenth of them popped again, so that the stacks are interleaved
+  and the free nodes are scattered. the sum, the maximum and the count
+  of the even values are computed following every stack from its head
+  and with the order-agnostic scans of the pool, for both layouts.
+*/
+constexpr std::size_t n_stacks = 1000;
+
+template <typename F>
+double best(F f) {
+  return repeat(5, [&]() { return seconds(f); }).front();
+}
+
+template <typename T, typename Layout>
+void run(const std::string& name, std::size_t n) {
+  stack_pool<T, std::uint32_t, Layout> pool{n};
+  std::vector<std::uint32_t> heads(n_stacks, pool.new_stack());
+  std::mt19937 gen{42};
+  for (std::size_t i = 0; i < n; ++i) {
+    auto& h = heads[gen() % n_stacks];
+    h = pool.push(T(gen() % 1000), h);
+  }
+  for (std::size_t i = 0; i < n / 10; ++i) {
+    auto& h = heads[gen() % n_stacks];
+    h = pool.pop(h);
+  }
+
+  auto follow = [&](auto init, auto op) {
+    for (auto h : heads)
+      for (auto it = pool.begin(h); it != pool.end(h); ++it)
+        init = op(init, *it);
+    return init;
+  };
+  auto max = [](T a, T b) { return std::max(a, b); };
+  auto even = [](T x) { return std::int64_t(x) % 2 == 0; };
+  auto count_even = [&](std::size_t c, T x) { return c + even(x); };
+
+  const double sum_follow = best([&]() { do_not_optimize(follow(T(0), std::plus<T>{})); });
+  const double sum_scan = best([&]() { do_not_optimize(pool.reduce_live(T(0), std::plus<T>{})); });
+  const double max_follow = best([&]() { do_not_optimize(follow(T(0), max)); });
+  const double max_scan = best([&]() { do_not_optimize(pool.reduce_live(T(0), max)); });
+  const double count_follow = best([&]() { do_not_optimize(follow(std::size_t(0), count_even)); });
+  const double count_scan = best([&]() { do_not_optimize(pool.count_live(even)); });
+  // float sums depend on the order, maxima and counts do not
+  if (follow(T(0), max) != pool.reduce_live(T(0), max) ||
+      follow(std::size_t(0), count_even) != pool.count_live(even))
+    std::cerr << "results differ" << std::endl;
+
+  const double m = 1e3;
+  std::cout << std::setw(12) << name << std::setw(12) << sum_follow * m
+            << std::setw(10) << sum_scan * m << std::setw(12) << max_follow * m
+            << std::setw(10) << max_scan * m << std::setw(12)
+            << count_follow * m << std::setw(10) << count_scan * m
+            << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  const std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+  std::cout << "times in ms" << std::endl;
+  std::cout << std::setw(12) << "pool" << std::setw(12) << "sum follow"
+            << std::setw(10) << "scan" << std::setw(12) << "max follow"
+            << std::setw(10) << "scan" << std::setw(12) << "even follow"
+            << std::setw(10) << "scan" << std::endl;
+  run<int, aos_layout>("int aos", n);
+  run<int, soa_layout>("int soa", n);
+  run<float, aos_layout>("float aos", n);
+  run<float, soa_layout>("float soa", n);
+}
@@ -0,0 +1,64 @@
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../stack_pool.hpp"
+#include "../unrolled_stack_pool.hpp"
+#include "bench.hpp"
+
+/*
+  n ints (1e7 by default, or argv[1]) pushed on one stack, or at random
+  on 1000 stacks so that the nodes of each stack are interleaved with
+  those of the others. for stack_pool and unrolled_stack_pool with
+  K = 4, 8 and 16 (all with 32 bit addresses) we measure the heap used
+  per value once the pool is shrunk to fit, the time per push, and the
+  time per value to sum every stack with its iterators.
+*/
+template <typename Pool>
+void run(const std::string& name, std::size_t n, std::size_t n_stacks) {
+  double t_push = 1e9, t_sum = 1e9, bytes = 0;
+  for (int r = 0; r < 3; ++r) {
+    const std::size_t heap = heap_in_use();
+    Pool pool{};
+    std::vector<std::uint32_t> heads(n_stacks, pool.new_stack());
+    std::vector<std::uint32_t> which(n);
+    std::mt19937 gen{42};
+    for (auto& w : which)
+      w = gen() % n_stacks;
+
+    t_push = std::min(t_push, seconds([&]() {
+      for (std::size_t i = 0; i < n; ++i)
+        heads[which[i]] = pool.push(int(i), heads[which[i]]);
+    }));
+    pool.shrink_to_fit();
+    bytes = double(heap_in_use() - heap - n * sizeof(std::uint32_t) -
+                   n_stacks * sizeof(std::uint32_t)) / n;
+    t_sum = std::min(t_sum, seconds([&]() {
+      long s = 0;
+      for (auto h : heads)
+        s = std::accumulate(pool.begin(h), pool.end(h), s);
+      do_not_optimize(s);
+    }));
+  }
+  std::cout << std::setw(16) << name << std::setw(8) << n_stacks
+            << std::setw(14) << bytes << std::setw(12) << t_push * 1e9 / n
+            << std::setw(12) << t_sum * 1e9 / n << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  const std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+  std::cout << std::setw(16) << "pool" << std::setw(8) << "stacks"
+            << std::setw(14) << "bytes/value" << std::setw(12) << "push [ns]"
+            << std::setw(12) << "sum [ns]" << std::endl;
+  for (std::size_t n_stacks : {1, 1000}) {
+    run<stack_pool<int, std::uint32_t>>("stack_pool", n, n_stacks);
+    run<unrolled_stack_pool<int, 4, std::uint32_t>>("unrolled K=4", n, n_stacks);
+    run<unrolled_stack_pool<int, 8, std::uint32_t>>("unrolled K=8", n, n_stacks);
+    run<unrolled_stack_pool<int, 16, std::uint32_t>>("unrolled K=16", n, n_stacks);
+  }
+}
@@ -0,0 +1,410 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "stack_pool.hpp"
+
+/*
+  policies for the Traffic parameter of concurrent_stack_pool, whose
+  moved(n) hook is called after every successful update of the shared
+  free list, with the number of nodes taken from it or given to it.
+  no_traffic, the default, does nothing. count_traffic adds them up, with
+  two relaxed atomic adds on counters shared by all the threads: it is
+  meant to measure how much a workload leans on the shared list, not to
+  be left on.
+*/
+struct no_traffic {
+  void moved(std::size_t) noexcept {}
+};
+
+struct count_traffic {
+  void moved(std::size_t n) noexcept {
+    n_nodes.fetch_add(n, std::memory_order_relaxed);
+    n_updates.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // nodes that went through the shared list, and compare-and-swaps that moved them
+  std::size_t shared_nodes() const noexcept { return n_nodes.load(std::memory_order_relaxed); }
+  std::size_t shared_updates() const noexcept { return n_updates.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<std::size_t> n_nodes{0};
+  std::atomic<std::size_t> n_updates{0};
+};
+
+/*
+  a pool of stacks shared by many threads.
+  every thread works on its own stacks (push, pop and free_stack on one
+  stack must not race with other operations on the same stack), while
+  the nodes are recycled through a single lock-free list of free nodes.
+
+  nodes live in chunks of geometrically increasing size: chunk k holds
+  (first_chunk << k) nodes and, once allocated, it is never moved, so
+  growing the pool never invalidates a node another thread is reading.
+
+  the head of the free list packs the index of the first free node (low
+  32 bits) and a generation tag (high 32 bits) in one atomic word. every
+  successful update increments the tag, so a thread that read the head
+  and got preempted fails its compare-and-swap even if in the meantime
+  the very same index went back on top of the list (ABA problem).
+
+  Traffic is told of every update of the free list (see no_traffic).
+*/
+template <typename T, typename N = std::uint32_t, typename Traffic = no_traffic>
+class concurrent_stack_pool : private Traffic {
+  static_assert(std::is_unsigned<N>::value &&
+                    sizeof(N) <= sizeof(std::uint32_t),
+                "indices must fit in the low half of the free list head");
+
+  struct node_t {
+    T value;
+    std::atomic<N> next;
+  };
+  using stack_type = N;
+  using value_type = T;
+  using size_type = std::size_t;
+  using tagged_type = std::uint64_t;
+
+  static constexpr unsigned first_chunk_bits = 10;
+  static constexpr size_type first_chunk = size_type(1) << first_chunk_bits;
+  static constexpr unsigned max_chunks = 33 - first_chunk_bits;
+
+  std::atomic<node_t*> chunks[max_chunks];
+  std::atomic<size_type> used;  // nodes ever taken from the chunks
+  std::atomic<tagged_type> free_nodes;  // at the beginning, it is empty
+
+  static unsigned log2(size_type j) noexcept { return 63 - __builtin_clzll(j); }
+
+  /*
+    node with address x is stored at position x-1 of the sequence made by
+    chunk 0, chunk 1, ... : shifting that position by first_chunk makes
+    the chunk number the position of its highest set bit.
+  */
+  node_t& node(stack_type x) noexcept { return locate(x); }
+  const node_t& node(stack_type x) const noexcept { return locate(x); }
+
+  node_t& locate(stack_type x) const noexcept {
+    const size_type j = size_type(x) - 1 + first_chunk;
+    const unsigned k = log2(j) - first_chunk_bits;
+    return chunks[k].load(std::memory_order_acquire)[j - (first_chunk << k)];
+  }
+
+  /*
+    allocate chunk k if nobody did it yet: when two threads race, the
+    loser of the compare-and-swap deletes its own copy.
+  */
+  void make_chunk(unsigned k) {
+    node_t* c = chunks[k].load(std::memory_order_acquire);
+    if (c != nullptr)
+      return;
+    std::unique_ptr<node_t[]> fresh{new node_t[first_chunk << k]};
+    if (chunks[k].compare_exchange_strong(c, fresh.get(),
+                                          std::memory_order_acq_rel,
+                                          std::memory_order_acquire))
+      fresh.release();
+  }
+
+  static stack_type index(tagged_type t) noexcept {
+    return stack_type(t & 0xffffffffu);
+  }
+  static tagged_type retag(stack_type x, tagged_type old) noexcept {
+    return (((old >> 32) + 1) << 32) | tagged_type(x);
+  }
+
+ public:
+  concurrent_stack_pool() : used{0}, free_nodes{0} {
+    for (auto& c : chunks)
+      c.store(nullptr, std::memory_order_relaxed);
+  }
+  explicit concurrent_stack_pool(size_type n) : concurrent_stack_pool{} {
+    reserve(n);
+  }  // reserve n nodes in the pool
+  ~concurrent_stack_pool() noexcept {
+    for (auto& c : chunks)
+      delete[] c.load(std::memory_order_relaxed);
+  }
+
+  concurrent_stack_pool(const concurrent_stack_pool&) = delete;
+  concurrent_stack_pool& operator=(const concurrent_stack_pool&) = delete;
+
+  using iterator = _iterator<concurrent_stack_pool, value_type, stack_type>;
+  using const_iterator =
+      _iterator<const concurrent_stack_pool, const value_type, stack_type>;
+
+  iterator begin(stack_type x) { return iterator{this, x}; }
+  iterator end(stack_type) { return iterator{this, end()}; }
+
+  const_iterator begin(stack_type x) const { return const_iterator{this, x}; }
+  const_iterator end(stack_type) const { return const_iterator{this, end()}; }
+
+  const_iterator cbegin(stack_type x) const { return const_iterator{this, x}; }
+  const_iterator cend(stack_type) const { return const_iterator{this, end()}; }
+
+  stack_type new_stack() const noexcept { return end(); }  // return an empty stack
+
+  /*
+    allocate in advance all the chunks needed to store n nodes,
+    so that no thread has to do it while pushing.
+  */
+  void reserve(size_type n) {
+    for (unsigned k = 0; k < max_chunks && (first_chunk << k) - first_chunk < n;
+         ++k)
+      make_chunk(k);
+  }
+
+  size_type capacity() const noexcept {
+    size_type c = 0;
+    for (unsigned k = 0; k < max_chunks; ++k)
+      if (chunks[k].load(std::memory_order_relaxed) != nullptr)
+        c += first_chunk << k;
+    return c;
+  }
+
+  // number of nodes taken from the chunks so far, free ones included
+  size_type size() const noexcept {
+    return used.load(std::memory_order_relaxed);
+  }
+
+  const Traffic& traffic() const noexcept { return *this; }
+
+  size_type max_size() const noexcept {
+    return std::numeric_limits<stack_type>::max();
+  }
+
+  bool empty(stack_type x) const noexcept { return x == end(); }
+
+  stack_type end() const noexcept { return stack_type(0); }
+
+  T& value(stack_type x) noexcept { return node(x).value; }
+  const T& value(stack_type x) const noexcept { return node(x).value; }
+
+  /*
+    links are atomic because a thread popping the free list may read the
+    link of a node that another thread is recycling at the same time;
+    that read is then discarded by the failing compare-and-swap.
+  */
+  stack_type next(stack_type x) const noexcept {
+    return node(x).next.load(std::memory_order_relaxed);
+  }
+
+  stack_type push(const T& val, stack_type head) { return _push(val, head); }
+  stack_type push(T&& val, stack_type head) {
+    return _push(std::move(val), head);
+  }
+
+  stack_type pop(stack_type x) noexcept {
+    if (empty(x))
+      return x;
+    const stack_type head = next(x);
+    free_chain(x, x, 1);
+    return head;
+  }
+
+  /*
+    the whole stack is spliced on top of the free list with a single
+    compare-and-swap, once its tail has been found.
+  */
+  stack_type free_stack(stack_type x) noexcept {
+    if (empty(x))
+      return end();
+    stack_type last = x;
+    size_type count = 1;
+    for (stack_type n = next(last); n != end(); n = next(n), ++count)
+      last = n;
+    free_chain(x, last, count);
+    return end();
+  }
+
+  /*
+    a cache of free nodes owned by one thread, in front of the shared
+    free list (the thread caches of tcmalloc, applied to indices).
+    push, pop and free_stack called with a magazine take and give nodes
+    to it, and the shared list is touched only to refill the magazine
+    with a batch of k nodes when it is empty or to flush k nodes back
+    when it holds 2k of them, with one compare-and-swap per batch.
+    a magazine must not outlive its pool: its destructor gives back
+    every node it still holds.
+  */
+  class magazine {
+    concurrent_stack_pool* p;
+    std::vector<stack_type> cache;  // the most recently freed node is last
+    size_type batch;
+    size_type n_refills{0};
+    size_type n_flushes{0};
+    size_type n_moved{0};  // nodes taken from or given to the shared list
+
+    friend class concurrent_stack_pool;
+
+    stack_type get() {
+      if (cache.empty())
+        refill();
+      const stack_type x = cache.back();
+      cache.pop_back();
+      return x;
+    }
+
+    void put(stack_type x) {
+      if (cache.size() == 2 * batch)
+        flush(batch);
+      cache.push_back(x);
+    }
+
+    void refill() {
+      ++n_refills;
+      n_moved += p->take_batch(batch, cache);
+      if (cache.empty()) {
+        // the shared list is empty as well: hand out brand new nodes
+        const stack_type first = p->fresh_nodes(batch);
+        for (size_type i = batch; i > 0; --i)
+          cache.push_back(stack_type(first + i - 1));
+      }
+    }
+
+    // give back the k least recently freed nodes, keeping the warm ones
+    void flush(size_type k) noexcept {
+      ++n_flushes;
+      n_moved += k;
+      p->free_batch(cache.data(), k);
+      cache.erase(cache.begin(), cache.begin() + k);
+    }
+
+   public:
+    explicit magazine(concurrent_stack_pool& pool, size_type k = 32)
+        : p{&pool}, batch{k < first_chunk ? (k > 0 ? k : 1) : first_chunk} {
+      cache.reserve(2 * batch);
+    }
+    ~magazine() noexcept {
+      if (!cache.empty())
+        flush(cache.size());
+    }
+
+    magazine(const magazine&) = delete;
+    magazine& operator=(const magazine&) = delete;
+
+    size_type size() const noexcept { return cache.size(); }
+    size_type refills() const noexcept { return n_refills; }
+    size_type flushes() const noexcept { return n_flushes; }
+    size_type shared_traffic() const noexcept { return n_moved; }
+  };
+
+  stack_type push(const T& val, stack_type head, magazine& m) {
+    return link(m.get(), val, head);
+  }
+  stack_type push(T&& val, stack_type head, magazine& m) {
+    return link(m.get(), std::move(val), head);
+  }
+
+  stack_type pop(stack_type x, magazine& m) {
+    if (empty(x))
+      return x;
+    const stack_type head = next(x);
+    m.put(x);
+    return head;
+  }
+
+  stack_type free_stack(stack_type x, magazine& m) {
+    while (!empty(x))
+      x = pop(x, m);
+    return end();
+  }
+
+ private:
+  /*
+    Treiber stack pop: on success the tag in the head guarantees that no
+    other thread changed the list between the load of the head and the
+    compare-and-swap, hence the link read from the old head was valid.
+  */
+  stack_type take_free() noexcept {
+    tagged_type old = free_nodes.load(std::memory_order_acquire);
+    while (index(old) != end()) {
+      const stack_type n =
+          node(index(old)).next.load(std::memory_order_relaxed);
+      if (free_nodes.compare_exchange_weak(old, retag(n, old),
+                                           std::memory_order_acquire,
+                                           std::memory_order_acquire)) {
+        Traffic::moved(1);
+        return index(old);
+      }
+    }
+    return end();
+  }
+
+  // push the chain first -> ... -> last, of n nodes, on top of the free list
+  void free_chain(stack_type first, stack_type last, size_type n) noexcept {
+    tagged_type old = free_nodes.load(std::memory_order_relaxed);
+    do {
+      node(last).next.store(index(old), std::memory_order_relaxed);
+    } while (!free_nodes.compare_exchange_weak(old, retag(first, old),
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed));
+    Traffic::moved(n);
+  }
+
+  /*
+    take k never used nodes at once and return the address of the first
+    one; k is at most first_chunk, so they span at most two chunks.
+  */
+  stack_type fresh_nodes(size_type k = 1) {
+    const size_type i = used.fetch_add(k, std::memory_order_relaxed);
+    if (i + k > max_size())
+      throw std::length_error{"concurrent_stack_pool: out of indices"};
+    make_chunk(log2(i + first_chunk) - first_chunk_bits);
+    make_chunk(log2(i + k - 1 + first_chunk) - first_chunk_bits);
+    return stack_type(i + 1);
+  }
+
+  /*
+    pop up to k nodes from the free list with a single compare-and-swap:
+    the walk may read links that other threads are changing, but then
+    the tag has changed too and the compare-and-swap fails. the check
+    against size() only avoids following a meaningless link meanwhile.
+  */
+  size_type take_batch(size_type k, std::vector<stack_type>& out) {
+    tagged_type old = free_nodes.load(std::memory_order_acquire);
+    while (index(old) != end()) {
+      const size_type first = out.size();
+      stack_type x = index(old);
+      for (size_type n = 0; n < k && x != end() && x <= size(); ++n) {
+        out.push_back(x);
+        x = next(x);
+      }
+      if (free_nodes.compare_exchange_weak(old, retag(x, old),
+                                           std::memory_order_acquire,
+                                           std::memory_order_acquire)) {
+        Traffic::moved(out.size() - first);
+        return out.size() - first;
+      }
+      out.resize(first);
+    }
+    return 0;
+  }
+
+  // link the n nodes in a and push them on the free list at once
+  void free_batch(const stack_type* a, size_type n) noexcept {
+    for (size_type i = 1; i < n; ++i)
+      node(a[i - 1]).next.store(a[i], std::memory_order_relaxed);
+    free_chain(a[0], a[n - 1], n);
+  }
+
+  template <typename D>
+  stack_type _push(D&& val, stack_type head) {
+    stack_type x = take_free();
+    if (empty(x))
+      x = fresh_nodes();
+    return link(x, std::forward<D>(val), head);
+  }
+
+  template <typename D>
+  stack_type link(stack_type x, D&& val, stack_type head) {
+    node_t& n = node(x);
+    n.value = std::forward<D>(val);
+    n.next.store(head, std::memory_order_relaxed);
+    return x;
+  }
+};
@@ -0,0 +1,284 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stack_pool.hpp"
+
+/*
+  a stack pool living in a file mapped in memory. the file holds a
+  small header (with the head of the free nodes), a table of roots where
+  the user stores the heads of the stacks to find them again, and the
+  array of nodes. opening an existing file maps it as it is: no parsing
+  and no copy, whatever the number of nodes.
+
+  since the bytes of the nodes are the file itself, T must be trivially
+  copyable and N an unsigned integer, and the file can be read back only
+  by a program with the same sizes and byte order: the header records
+  them and the constructor refuses a file that does not match.
+
+  growing the pool extends the file and maps it again, so references to
+  values are invalidated by push exactly as with std::vector. changes
+  reach the file when the kernel decides, unless sync() is called.
+*/
+template <typename T, typename N = std::size_t>
+class mapped_stack_pool {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "values are stored as raw bytes in the file");
+  static_assert(std::is_integral<N>::value && std::is_unsigned<N>::value,
+                "addresses are stored as raw bytes in the file");
+
+  struct node_t {
+    T value;
+    N next;
+  };
+
+  using stack_type = N;
+  using value_type = T;
+  using size_type = std::size_t;
+
+  struct header_t {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint32_t value_size;
+    std::uint32_t index_size;
+    std::uint64_t node_size;
+    std::uint64_t n_roots;
+    std::uint64_t size;  // nodes in use, free ones included
+    std::uint64_t capacity;  // nodes the file can hold
+    std::uint64_t free_nodes;
+  };
+
+  static constexpr char magic[8] = "stkpool";
+  static constexpr std::uint32_t version = 1;
+  static constexpr std::uint32_t byte_order = 0x01020304;
+  static constexpr size_type initial_capacity = 1024;
+
+  int fd;
+  char* base;  // start of the mapping
+  size_type mapped;  // bytes mapped
+
+  header_t& header() noexcept { return *reinterpret_cast<header_t*>(base); }
+  const header_t& header() const noexcept {
+    return *reinterpret_cast<const header_t*>(base);
+  }
+
+  // nodes start after header and roots, aligned for node_t
+  size_type nodes_offset() const noexcept {
+    const size_type n = sizeof(header_t) + header().n_roots * sizeof(N);
+    return (n + alignof(node_t) - 1) / alignof(node_t) * alignof(node_t);
+  }
+
+  size_type file_size(size_type capacity) const noexcept {
+    return nodes_offset() + capacity * sizeof(node_t);
+  }
+
+  node_t* nodes() noexcept {
+    return reinterpret_cast<node_t*>(base + nodes_offset());
+  }
+  const node_t* nodes() const noexcept {
+    return reinterpret_cast<const node_t*>(base + nodes_offset());
+  }
+
+  node_t& node(stack_type x) noexcept { return nodes()[x - 1]; }
+  const node_t& node(stack_type x) const noexcept { return nodes()[x - 1]; }
+
+  [[noreturn]] static void fail(const std::string& what) {
+    throw std::system_error{errno, std::generic_category(),
+                            "mapped_stack_pool: " + what};
+  }
+
+  void map(size_type bytes) {
+    void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+      fail("mmap");
+    base = static_cast<char*>(p);
+    mapped = bytes;
+  }
+
+  void unmap() noexcept {
+    if (base != nullptr)
+      ::munmap(base, mapped);
+    base = nullptr;
+    mapped = 0;
+  }
+
+  void create(size_type n_roots) {
+    header_t h{};
+    std::memcpy(h.magic, magic, sizeof(magic));
+    h.version = version;
+    h.byte_order = byte_order;
+    h.value_size = sizeof(T);
+    h.index_size = sizeof(N);
+    h.node_size = sizeof(node_t);
+    h.n_roots = n_roots;
+    h.size = 0;
+    h.capacity = 0;
+    h.free_nodes = 0;
+    if (::ftruncate(fd, sizeof(header_t)) != 0)
+      fail("ftruncate");
+    map(sizeof(header_t));
+    header() = h;
+    grow(initial_capacity);  // also zeroes the roots
+  }
+
+  void check(size_type bytes) const {
+    const header_t& h = header();
+    if (bytes < sizeof(header_t) ||
+        std::memcmp(h.magic, magic, sizeof(magic)) != 0)
+      throw std::runtime_error{"mapped_stack_pool: not a pool file"};
+    if (h.version != version || h.byte_order != byte_order ||
+        h.value_size != sizeof(T) || h.index_size != sizeof(N) ||
+        h.node_size != sizeof(node_t))
+      throw std::runtime_error{"mapped_stack_pool: incompatible pool file"};
+    if (bytes < file_size(h.capacity) || h.size > h.capacity)
+      throw std::runtime_error{"mapped_stack_pool: truncated pool file"};
+  }
+
+  // extend the file to hold n nodes and map it again
+  void grow(size_type n) {
+    const size_type bytes = file_size(n);
+    if (::ftruncate(fd, bytes) != 0)
+      fail("ftruncate");
+    unmap();
+    map(bytes);
+    header().capacity = n;
+  }
+
+ public:
+  /*
+    open the pool stored in path, creating it (with room for n_roots
+    heads of stacks) if the file does not exist or is empty.
+  */
+  explicit mapped_stack_pool(const std::string& path, size_type n_roots = 16)
+      : fd{-1}, base{nullptr}, mapped{0} {
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+      fail("cannot open " + path);
+    try {
+      struct stat st;
+      if (::fstat(fd, &st) != 0)
+        fail("fstat");
+      if (st.st_size == 0) {
+        create(n_roots);
+      } else {
+        map(st.st_size);
+        check(st.st_size);
+      }
+    } catch (...) {
+      unmap();
+      ::close(fd);
+      throw;
+    }
+  }
+
+  ~mapped_stack_pool() noexcept {
+    unmap();
+    ::close(fd);
+  }
+
+  mapped_stack_pool(const mapped_stack_pool&) = delete;
+  mapped_stack_pool& operator=(const mapped_stack_pool&) = delete;
+
+  using iterator = _iterator<mapped_stack_pool, value_type, stack_type>;
+  using const_iterator =
+      _iterator<const mapped_stack_pool, const value_type, stack_type>;
+
+  iterator begin(stack_type x) { return iterator{this, x}; }
+  iterator end(stack_type) { return iterator{this, end()}; }
+
+  const_iterator begin(stack_type x) const { return const_iterator{this, x}; }
+  const_iterator end(stack_type) const { return const_iterator{this, end()}; }
+
+  const_iterator cbegin(stack_type x) const { return const_iterator{this, x}; }
+  const_iterator cend(stack_type) const { return const_iterator{this, end()}; }
+
+  stack_type new_stack() const noexcept { return end(); }  // return an empty stack
+
+  void reserve(size_type n) {
+    if (n > capacity())
+      grow(n);
+  }
+  size_type capacity() const noexcept { return header().capacity; }
+  size_type size() const noexcept { return header().size; }
+
+  /*
+    the roots are stored in the file together with the nodes: a stack
+    whose head is kept in a root is found again when the file is reopened.
+  */
+  size_type n_roots() const noexcept { return header().n_roots; }
+  stack_type& root(size_type i) noexcept {
+    return reinterpret_cast<N*>(base + sizeof(header_t))[i];
+  }
+  const stack_type& root(size_type i) const noexcept {
+    return reinterpret_cast<const N*>(base + sizeof(header_t))[i];
+  }
+
+  // flush every change to the file, waiting for the write to complete
+  void sync() {
+    if (::msync(base, mapped, MS_SYNC) != 0)
+      fail("msync");
+  }
+
+  bool empty(stack_type x) const noexcept { return x == end(); }
+
+  stack_type end() const noexcept { return stack_type(0); }
+
+  T& value(stack_type x) noexcept { return node(x).value; }
+  const T& value(stack_type x) const noexcept { return node(x).value; }
+
+  stack_type& next(stack_type x) noexcept { return node(x).next; }
+  const stack_type& next(stack_type x) const noexcept { return node(x).next; }
+
+  /*
+    val is copied first: it may be a value of this pool, which growing
+    the file would move somewhere else.
+  */
+  stack_type push(const T& val, stack_type head) {
+    const node_t n{val, head};
+    stack_type x = stack_type(header().free_nodes);
+    if (!empty(x)) {
+      header().free_nodes = next(x);
+    } else {
+      if (size() == capacity())
+        grow(2 * capacity());
+      x = stack_type(++header().size);
+    }
+    node(x) = n;
+    return x;
+  }
+
+  stack_type pop(stack_type x) noexcept {
+    if (empty(x))
+      return x;
+    const stack_type head = next(x);
+    next(x) = stack_type(header().free_nodes);
+    header().free_nodes = x;
+    return head;
+  }
+
+  stack_type free_stack(stack_type x) noexcept {
+    if (empty(x))
+      return end();
+    stack_type last = x;
+    while (!empty(next(last)))
+      last = next(last);
+    next(last) = stack_type(header().free_nodes);
+    header().free_nodes = x;
+    return end();
+  }
+};
+
+template <typename T, typename N>
+constexpr char mapped_stack_pool<T, N>::magic[8];
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+  a set of threads that run a job on many independent items (here, the
+  stacks of a pool) and return when all of them are done. the threads
+  are started once and wait between jobs, so a job costs a wake-up
+  instead of a thread creation.
+
+  the items are split in equal contiguous ranges, one per thread (the
+  calling thread works too). a thread takes the items of its range one
+  by one from the front; once it is empty, it steals the back half of
+  the range of another thread. stacks can be very uneven, and a static
+  split would leave the threads with the short ones idle while one of
+  them walks the long ones.
+
+  a range packs its first item (low 32 bits) and its end (high 32 bits)
+  in one atomic word, so that the owner taking an item and a thief
+  taking half are both a compare-and-swap on the same word. a job has
+  at most 2^32 - 1 items.
+*/
+class stack_workers {
+  // padded to a cache line, so that threads do not share one
+  struct range {
+    std::atomic<std::uint64_t> bounds;
+    char pad[64 - sizeof(std::atomic<std::uint64_t>)];
+  };
+
+  static std::uint64_t pack(std::size_t first, std::size_t last) noexcept {
+    return (std::uint64_t(last) << 32) | std::uint64_t(first);
+  }
+  static std::size_t first(std::uint64_t b) noexcept { return b & 0xffffffffu; }
+  static std::size_t last(std::uint64_t b) noexcept { return b >> 32; }
+
+  unsigned n_workers;
+  std::unique_ptr<range[]> ranges;
+  std::vector<std::thread> threads;
+
+  // the current job: call(context, i) for every item i
+  void (*call)(void*, std::size_t) = nullptr;
+  void* context = nullptr;
+  std::atomic<bool> failed{false};
+  std::exception_ptr error;
+
+  std::mutex m;
+  std::condition_variable wake, done;
+  std::uint64_t job = 0;  // number of jobs started
+  unsigned running = 0;   // threads still working on the current job
+  bool stopping = false;
+
+  bool take(unsigned id, std::size_t& i) noexcept {
+    auto& bounds = ranges[id].bounds;
+    std::uint64_t b = bounds.load(std::memory_order_acquire);
+    while (first(b) < last(b))
+      if (bounds.compare_exchange_weak(b, pack(first(b) + 1, last(b)),
+                                       std::memory_order_acq_rel)) {
+        i = first(b);
+        return true;
+      }
+    return false;
+  }
+
+  // move the back half of the range of some other thread into ours
+  bool steal(unsigned id) noexcept {
+    for (unsigned k = 1; k < n_workers; ++k) {
+      auto& bounds = ranges[(id + k) % n_workers].bounds;
+      std::uint64_t b = bounds.load(std::memory_order_acquire);
+      while (first(b) < last(b)) {
+        const std::size_t middle = last(b) - (last(b) - first(b) + 1) / 2;
+        if (bounds.compare_exchange_weak(b, pack(first(b), middle),
+                                         std::memory_order_acq_rel)) {
+          ranges[id].bounds.store(pack(middle, last(b)),
+                                  std::memory_order_release);
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  void work(unsigned id) noexcept {
+    std::size_t i;
+    do {
+      while (take(id, i)) {
+        if (failed.load(std::memory_order_relaxed))
+          continue;  // an item threw: drain the ranges without running
+        try {
+          call(context, i);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock{m};
+          if (!failed.exchange(true))
+            error = std::current_exception();
+        }
+      }
+    } while (steal(id));
+  }
+
+  void loop(unsigned id) {
+    std::uint64_t seen = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock{m};
+        wake.wait(lock, [&]() { return stopping || job != seen; });
+        if (stopping)
+          return;
+        seen = job;
+      }
+      work(id);
+      std::lock_guard<std::mutex> lock{m};
+      if (--running == 0)
+        done.notify_one();
+    }
+  }
+
+ public:
+  // n threads in all, the one calling run included
+  explicit stack_workers(unsigned n = std::thread::hardware_concurrency())
+      : n_workers{n == 0 ? 1 : n}, ranges{new range[n_workers]} {
+    for (unsigned id = 0; id < n_workers; ++id)
+      ranges[id].bounds.store(0, std::memory_order_relaxed);
+    threads.reserve(n_workers - 1);
+    try {
+      for (unsigned id = 1; id < n_workers; ++id)
+        threads.emplace_back([this, id]() { loop(id); });
+    } catch (...) {
+      stop();
+      throw;
+    }
+  }
+
+  ~stack_workers() noexcept { stop(); }
+
+  stack_workers(const stack_workers&) = delete;
+  stack_workers& operator=(const stack_workers&) = delete;
+
+  unsigned size() const noexcept { return n_workers; }
+
+  /*
+    call f(i) for every i in [0, n), spread over the threads, and wait
+    for all the calls to finish. if some of them throw, the first
+    exception is rethrown here and the items not started yet are
+    skipped. run must not be called by two threads at once.
+  */
+  template <typename F>
+  void run(std::size_t n, F&& f) {
+    if (n == 0)
+      return;
+    if (n >= (std::size_t(1) << 32))
+      throw std::length_error{"stack_workers: too many items"};
+    using G = typename std::remove_reference<F>::type;
+    call = [](void* c, std::size_t i) { (*static_cast<G*>(c))(i); };
+    context = const_cast<void*>(static_cast<const void*>(std::addressof(f)));
+    failed.store(false, std::memory_order_relaxed);
+    error = nullptr;
+    for (unsigned id = 0; id < n_workers; ++id)
+      ranges[id].bounds.store(pack(n * id / n_workers, n * (id + 1) / n_workers),
+                              std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> lock{m};
+      ++job;
+      running = n_workers - 1;
+    }
+    wake.notify_all();
+    work(0);
+    std::unique_lock<std::mutex> lock{m};
+    done.wait(lock, [&]() { return running == 0; });
+    if (error)
+      std::rethrow_exception(std::exchange(error, nullptr));
+  }
+
+ private:
+  void stop() noexcept {
+    {
+      std::lock_guard<std::mutex> lock{m};
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto& t : threads)
+      t.join();
+  }
+};
+
+/*
+  call f(i, heads[i]) for every stack of a pool, in parallel. f may read
+  the pool and write to anything owned by stack i, but must not push or
+  pop: a stack_pool is not safe to modify from many threads.
+*/
+template <typename Stack, typename F>
+void for_each_stack(stack_workers& workers, const std::vector<Stack>& heads,
+                    F f) {
+  workers.run(heads.size(), [&](std::size_t i) { f(i, heads[i]); });
+}
+
+/*
+  for every stack, reduce(... reduce(reduce(init, transform(v1)),
+  transform(v2)) ...) over its values from the top, in parallel: the
+  results come back in the order of heads. for example the sum of each
+  stack is transform_reduce_stacks(workers, pool, heads, 0L,
+  std::plus<long>{}, [](int x) { return x; }).
+*/
+template <typename Pool, typename Stack, typename R, typename Reduce,
+          typename Transform>
+std::vector<R> transform_reduce_stacks(stack_workers& workers,
+                                       const Pool& pool,
+                                       const std::vector<Stack>& heads,
+                                       R init, Reduce reduce,
+                                       Transform transform) {
+  static_assert(!std::is_same<R, bool>::value,
+                "the elements of std::vector<bool> cannot be written by many threads");
+  std::vector<R> results(heads.size(), init);
+  for_each_stack(workers, heads, [&](std::size_t i, Stack head) {
+    R r = init;
+    for (auto it = pool.begin(head); it != pool.end(head); ++it)
+      r = reduce(std::move(r), transform(*it));
+    results[i] = std::move(r);
+  });
+  return results;
+}
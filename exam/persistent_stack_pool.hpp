@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "stack_pool.hpp"
+
+/*
+  the value of a node of a persistent_stack_pool, with the number of
+  references to the node: the stacks whose head it is, and the nodes
+  linked to it. Count can be as small as the sharing allows: with int
+  values and std::uint32_t links and counts a node takes 12 bytes.
+*/
+template <typename T, typename Count>
+struct _persistent_node {
+  T value;
+  Count refs;
+
+  template <typename... Args>
+  explicit _persistent_node(Count r, Args&&... args) : value(std::forward<Args>(args)...), refs{r} {}
+};
+
+/*
+  a pool of persistent stacks: a node is never changed once pushed, so
+  stacks can share their nodes below the top, and every version of a
+  stack costs one node per push, however long the part it shares.
+
+  a stack_type is a reference to its first node, counted by the node:
+  push and pop take the reference they are given and return a new one,
+  as in stack_pool (h = pool.push(42, h); h = pool.pop(h);), and a
+  node is freed when its last reference goes away. to keep a version
+  and build on it, take another reference with share:
+
+    auto child = pool.push(42, pool.share(parent));
+
+  and give back every reference with free_stack (or pop). freeing a
+  stack frees its nodes down to the first one still shared, so the live
+  nodes are the distinct nodes reachable from the live stacks. counts
+  that would overflow Count throw std::length_error.
+*/
+template <typename T, typename N = std::size_t, typename Count = std::uint32_t>
+class persistent_stack_pool {
+  static_assert(std::is_unsigned<Count>::value, "the reference count must be unsigned");
+
+  using node_type = _persistent_node<T, Count>;
+  stack_pool<node_type, N> pool;
+  std::size_t n_nodes = 0;
+
+  using stack_type = N;
+  using value_type = T;
+  using size_type = std::size_t;
+
+ public:
+  persistent_stack_pool() = default;
+  explicit persistent_stack_pool(size_type n) : pool{n} {}  // reserve n nodes in the pool
+
+  using const_iterator = _iterator<const persistent_stack_pool, const value_type, stack_type>;
+  using iterator = const_iterator;  // the values are immutable
+
+  const_iterator begin(stack_type x) const { return const_iterator{this, x}; }
+  const_iterator end(stack_type) const { return const_iterator{this, end()}; }
+
+  const_iterator cbegin(stack_type x) const { return begin(x); }
+  const_iterator cend(stack_type x) const { return end(x); }
+
+  stack_type new_stack() const noexcept { return end(); }  // return an empty stack
+
+  void reserve(size_type n) { pool.reserve(n); }
+  size_type capacity() const noexcept { return pool.capacity(); }
+
+  size_type nodes() const noexcept { return n_nodes; }  // the nodes in use, shared or not
+
+  bool empty(stack_type x) const noexcept { return x == end(); }
+
+  stack_type end() const noexcept { return stack_type(0); }
+
+  const T& value(stack_type x) const noexcept { return pool.value(x).value; }
+  stack_type next(stack_type x) const noexcept { return pool.next(x); }
+
+  // the references to the node: 1 if no other stack or node reaches it
+  size_type use_count(stack_type x) const noexcept { return empty(x) ? 0 : pool.value(x).refs; }
+
+  // another reference to the same stack
+  stack_type share(stack_type x) {
+    retain(x);
+    return x;
+  }
+
+  stack_type push(const T& val, stack_type head) { return _push(head, val); }
+  stack_type push(T&& val, stack_type head) { return _push(head, std::move(val)); }
+
+  template <typename... Args>
+  stack_type emplace(stack_type head, Args&&... args) {
+    return _push(head, std::forward<Args>(args)...);
+  }
+
+  /*
+    the stack below the top. if no one else has the top node, it is freed
+    and its link becomes the returned reference; otherwise the top node
+    stays, and the node below gets one more reference.
+  */
+  stack_type pop(stack_type x) {
+    if (empty(x))
+      return x;
+    auto& refs = pool.value(x).refs;
+    if (refs == 1) {
+      --n_nodes;
+      return pool.pop(x);
+    }
+    const stack_type below = next(x);
+    retain(below);
+    --refs;
+    return below;
+  }
+
+  // the nodes of the stack down to the first shared one are freed with a single splice
+  stack_type free_stack(stack_type x) noexcept {
+    size_type k = 0;
+    stack_type shared = x;
+    for (; !empty(shared) && pool.value(shared).refs == 1; shared = next(shared))
+      ++k;
+    pool.pop_n(x, k);
+    n_nodes -= k;
+    if (!empty(shared))
+      --pool.value(shared).refs;
+    return end();
+  }
+
+ private:
+  void retain(stack_type x) {
+    if (empty(x))
+      return;
+    auto& refs = pool.value(x).refs;
+    if (refs == std::numeric_limits<Count>::max())
+      throw std::length_error("persistent_stack_pool: too many references to a node");
+    ++refs;
+  }
+
+  template <typename... Args>
+  stack_type _push(stack_type head, Args&&... args) {
+    const stack_type x = pool.emplace(head, Count(1), std::forward<Args>(args)...);
+    ++n_nodes;
+    return x;
+  }
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#if __cplusplus < 201703L
+#error "pool_memory_resource.hpp needs C++17 (std::pmr)"
+#endif
+
+#include <cstddef>
+#include <memory_resource>
+
+/*
+  the free list of stack_pool, for any node-based container: a memory
+  resource handing out blocks of one size, carved one after the other
+  from big contiguous chunks. a freed block goes on top of a list of
+  free blocks, linked through the blocks themselves, and the next
+  allocation takes it back: the nodes of a std::pmr::list, std::pmr::map
+  or std::pmr::unordered_map are then packed together, and reused where
+  the freed ones were, instead of being scattered by the general
+  purpose allocator.
+
+  the block size is chosen at construction and must be at least the
+  size of the nodes of the container (e.g. 48 bytes for a std::set of
+  ints with libstdc++). larger requests, such as the buckets of an
+  unordered_map, and over-aligned ones go to the upstream resource. the
+  chunks start with chunk_blocks blocks and double every time, up to
+  max_chunk_blocks; they are given back only by release() and by the
+  destructor. as for stack_pool, there is no locking: a resource must
+  not be used by two threads at once.
+*/
+class pool_memory_resource : public std::pmr::memory_resource {
+  // the head of a chunk, followed by its blocks
+  struct chunk {
+    chunk* previous;
+    std::size_t bytes;
+  };
+
+  static constexpr std::size_t header_size =
+      (sizeof(chunk) + alignof(std::max_align_t) - 1) /
+      alignof(std::max_align_t) * alignof(std::max_align_t);
+  static constexpr std::size_t max_chunk_blocks = std::size_t(1) << 20;
+
+  std::size_t size;        // of a block
+  std::size_t alignment;   // of every block
+  std::size_t next_blocks;  // in the next chunk
+  std::pmr::memory_resource* upstream;
+
+  chunk* chunks = nullptr;  // the last one allocated
+  char* first_unused = nullptr;  // blocks never handed out, in the last chunk
+  char* last_unused = nullptr;
+  void* free_blocks = nullptr;
+
+  static void*& link(void* block) noexcept { return *static_cast<void**>(block); }
+
+  bool pooled(std::size_t bytes, std::size_t align) const noexcept {
+    return bytes <= size && align <= alignment;
+  }
+
+  void add_chunk() {
+    const std::size_t bytes = header_size + next_blocks * size;
+    auto c = static_cast<chunk*>(upstream->allocate(bytes, alignof(std::max_align_t)));
+    c->previous = chunks;
+    c->bytes = bytes;
+    chunks = c;
+    first_unused = reinterpret_cast<char*>(c) + header_size;
+    last_unused = reinterpret_cast<char*>(c) + bytes;
+    if (next_blocks < max_chunk_blocks)
+      next_blocks *= 2;
+  }
+
+ protected:
+  void* do_allocate(std::size_t bytes, std::size_t align) override {
+    if (!pooled(bytes, align))
+      return upstream->allocate(bytes, align);
+    if (free_blocks != nullptr) {
+      void* block = free_blocks;
+      free_blocks = link(block);
+      return block;
+    }
+    if (first_unused == last_unused)
+      add_chunk();
+    void* block = first_unused;
+    first_unused += size;
+    return block;
+  }
+
+  void do_deallocate(void* p, std::size_t bytes, std::size_t align) override {
+    if (!pooled(bytes, align))
+      return upstream->deallocate(p, bytes, align);
+    link(p) = free_blocks;
+    free_blocks = p;
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+
+ public:
+  /*
+    the block size is rounded up to hold a pointer, and to a multiple of
+    its alignment: the largest power of two dividing it, at most
+    alignof(std::max_align_t).
+  */
+  explicit pool_memory_resource(
+      std::size_t block_size, std::size_t chunk_blocks = 1024,
+      std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+      : size{block_size < sizeof(void*) ? sizeof(void*) : block_size},
+        alignment{alignof(std::max_align_t)},
+        next_blocks{chunk_blocks == 0 ? 1 : chunk_blocks},
+        upstream{upstream} {
+    size = (size + alignof(void*) - 1) / alignof(void*) * alignof(void*);
+    while (size % alignment != 0)
+      alignment /= 2;
+  }
+
+  ~pool_memory_resource() override { release(); }
+
+  pool_memory_resource(const pool_memory_resource&) = delete;
+  pool_memory_resource& operator=(const pool_memory_resource&) = delete;
+
+  std::size_t block_size() const noexcept { return size; }
+  std::pmr::memory_resource* upstream_resource() const noexcept { return upstream; }
+
+  // the bytes taken from upstream for the chunks
+  std::size_t chunk_bytes() const noexcept {
+    std::size_t n = 0;
+    for (auto c = chunks; c != nullptr; c = c->previous)
+      n += c->bytes;
+    return n;
+  }
+
+  /*
+    give every chunk back to upstream, even if some of its blocks were
+    not deallocated: whatever still points to them is left dangling.
+  */
+  void release() noexcept {
+    while (chunks != nullptr) {
+      chunk* c = chunks;
+      chunks = c->previous;
+      upstream->deallocate(c, c->bytes, alignof(std::max_align_t));
+    }
+    first_unused = last_unused = nullptr;
+    free_blocks = nullptr;
+  }
+};
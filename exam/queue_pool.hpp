@@ -0,0 +1,224 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+#include "stack_pool.hpp"
+
+/*
+  a pool of FIFO queues: the nodes live in a stack_pool, whose free list
+  recycles them, and a queue is a stack descriptor (first node, last
+  node and length) linked from the front, the first value to come out,
+  to the back, the last value that came in. enqueue links a new node
+  after the last one, dequeue pops the first: both are O(1), and so is
+  freeing a whole queue, which is spliced on the free nodes.
+
+  as with stack_pool, every operation returns the updated queue:
+  q = pool.enqueue(42, q); and iterators go from the front to the back.
+*/
+template <typename T, typename N = std::size_t>
+class queue_pool {
+  using pool_type = stack_pool<T, N>;
+  pool_type pool;
+
+  using stack_type = N;
+  using value_type = T;
+  using size_type = std::size_t;
+
+ public:
+  using queue_type = typename pool_type::stack_descriptor;
+
+  queue_pool() = default;
+  explicit queue_pool(size_type n) : pool{n} {}  // reserve n nodes in the pool
+
+  using iterator = typename pool_type::iterator;
+  using const_iterator = typename pool_type::const_iterator;
+
+  iterator begin(const queue_type& q) { return pool.begin(q.head); }
+  iterator end(const queue_type& q) { return pool.end(q.head); }
+
+  const_iterator begin(const queue_type& q) const { return pool.begin(q.head); }
+  const_iterator end(const queue_type& q) const { return pool.end(q.head); }
+
+  const_iterator cbegin(const queue_type& q) const { return pool.cbegin(q.head); }
+  const_iterator cend(const queue_type& q) const { return pool.cend(q.head); }
+
+  queue_type new_queue() const noexcept { return pool.new_descriptor(); }  // return an empty queue
+
+  void reserve(size_type n) { pool.reserve(n); }
+  size_type capacity() const noexcept { return pool.capacity(); }
+
+  bool empty(const queue_type& q) const noexcept { return pool.empty(q); }
+  size_type size(const queue_type& q) const noexcept { return pool.size(q); }
+
+  T& front(const queue_type& q) noexcept { return pool.value(q.head); }
+  const T& front(const queue_type& q) const noexcept { return pool.value(q.head); }
+  T& back(const queue_type& q) noexcept { return pool.value(q.tail); }
+  const T& back(const queue_type& q) const noexcept { return pool.value(q.tail); }
+
+  queue_type enqueue(const T& val, queue_type q) { return _enqueue(q, val); }
+  queue_type enqueue(T&& val, queue_type q) { return _enqueue(q, std::move(val)); }
+
+  template <typename... Args>
+  queue_type emplace(queue_type q, Args&&... args) {
+    return _enqueue(q, std::forward<Args>(args)...);
+  }
+
+  queue_type dequeue(queue_type q) noexcept { return pool.pop(q); }
+
+  queue_type free_queue(queue_type q) noexcept { return pool.free_stack(q); }
+
+ private:
+  template <typename... Args>
+  queue_type _enqueue(queue_type q, Args&&... args) {
+    const stack_type x = pool.emplace(pool.new_stack(), std::forward<Args>(args)...);
+    if (empty(q))
+      q.head = x;
+    else
+      pool.next(q.tail) = x;
+    q.tail = x;
+    ++q.size;
+    return q;
+  }
+};
+
+/*
+  the value of a node of a deque_pool, with the link to the node before
+  it: the link to the node after it is the one kept by stack_pool.
+*/
+template <typename T, typename N>
+struct _deque_node {
+  T value;
+  N prev;
+
+  template <typename... Args>
+  explicit _deque_node(N p, Args&&... args)
+      : value(std::forward<Args>(args)...), prev{p} {}
+};
+
+/*
+  a pool of double-ended queues, linked both ways: values can be pushed
+  and popped at both ends in O(1). a deque is known by its first and
+  last node and its length, and the functions taking one return it
+  updated: d = pool.push_back(42, d); iterators go from the front to
+  the back, prev(x) and next(x) walk the nodes both ways.
+*/
+template <typename T, typename N = std::size_t>
+class deque_pool {
+  using node_type = _deque_node<T, N>;
+  stack_pool<node_type, N> pool;
+
+  using stack_type = N;
+  using value_type = T;
+  using size_type = std::size_t;
+
+ public:
+  struct deque_type {
+    stack_type front;
+    stack_type back;
+    size_type size;
+  };
+
+  deque_pool() = default;
+  explicit deque_pool(size_type n) : pool{n} {}  // reserve n nodes in the pool
+
+  using iterator = _iterator<deque_pool, value_type, stack_type>;
+  using const_iterator = _iterator<const deque_pool, const value_type, stack_type>;
+
+  iterator begin(const deque_type& d) { return iterator{this, d.front}; }
+  iterator end(const deque_type&) { return iterator{this, end()}; }
+
+  const_iterator begin(const deque_type& d) const { return const_iterator{this, d.front}; }
+  const_iterator end(const deque_type&) const { return const_iterator{this, end()}; }
+
+  const_iterator cbegin(const deque_type& d) const { return const_iterator{this, d.front}; }
+  const_iterator cend(const deque_type&) const { return const_iterator{this, end()}; }
+
+  deque_type new_deque() const noexcept { return {end(), end(), 0}; }  // return an empty deque
+
+  void reserve(size_type n) { pool.reserve(n); }
+  size_type capacity() const noexcept { return pool.capacity(); }
+
+  bool empty(const deque_type& d) const noexcept { return d.size == 0; }
+  size_type size(const deque_type& d) const noexcept { return d.size; }
+
+  stack_type end() const noexcept { return stack_type(0); }
+
+  T& value(stack_type x) noexcept { return pool.value(x).value; }
+  const T& value(stack_type x) const noexcept { return pool.value(x).value; }
+
+  stack_type next(stack_type x) const noexcept { return pool.next(x); }
+  stack_type prev(stack_type x) const noexcept { return pool.value(x).prev; }
+
+  T& front(const deque_type& d) noexcept { return value(d.front); }
+  const T& front(const deque_type& d) const noexcept { return value(d.front); }
+  T& back(const deque_type& d) noexcept { return value(d.back); }
+  const T& back(const deque_type& d) const noexcept { return value(d.back); }
+
+  deque_type push_front(const T& val, deque_type d) { return _push_front(d, val); }
+  deque_type push_front(T&& val, deque_type d) { return _push_front(d, std::move(val)); }
+  deque_type push_back(const T& val, deque_type d) { return _push_back(d, val); }
+  deque_type push_back(T&& val, deque_type d) { return _push_back(d, std::move(val)); }
+
+  template <typename... Args>
+  deque_type emplace_front(deque_type d, Args&&... args) {
+    return _push_front(d, std::forward<Args>(args)...);
+  }
+  template <typename... Args>
+  deque_type emplace_back(deque_type d, Args&&... args) {
+    return _push_back(d, std::forward<Args>(args)...);
+  }
+
+  deque_type pop_front(deque_type d) noexcept {
+    if (empty(d))
+      return d;
+    d.front = pool.pop(d.front);
+    if (--d.size == 0)
+      d.back = end();
+    else
+      pool.value(d.front).prev = end();
+    return d;
+  }
+
+  deque_type pop_back(deque_type d) noexcept {
+    if (empty(d))
+      return d;
+    const stack_type x = d.back;
+    d.back = prev(x);
+    pool.pop(x);
+    if (--d.size == 0)
+      d.front = end();
+    else
+      pool.next(d.back) = end();
+    return d;
+  }
+
+  // the nodes are spliced on the free list, as for a stack descriptor
+  deque_type free_deque(deque_type d) noexcept {
+    pool.free_stack(typename stack_pool<node_type, N>::stack_descriptor{d.front, d.back, d.size});
+    return new_deque();
+  }
+
+ private:
+  template <typename... Args>
+  deque_type _push_front(deque_type d, Args&&... args) {
+    const stack_type x = pool.emplace(d.front, end(), std::forward<Args>(args)...);
+    if (d.size++ == 0)
+      d.back = x;
+    else
+      pool.value(d.front).prev = x;
+    d.front = x;
+    return d;
+  }
+
+  template <typename... Args>
+  deque_type _push_back(deque_type d, Args&&... args) {
+    const stack_type x = pool.emplace(end(), d.back, std::forward<Args>(args)...);
+    if (d.size++ == 0)
+      d.front = x;
+    else
+      pool.next(d.back) = x;
+    d.back = x;
+    return d;
+  }
+};
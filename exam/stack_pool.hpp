@@ -1,5 +1,19 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <iostream>
 #include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 template <typename stack_pool, typename T, typename N = std::size_t>
 class _iterator {
@@ -35,25 +49,1209 @@ public:
     }
 }; 
 
-template <typename T, typename N = std::size_t>
-class stack_pool{
-  struct node_t{
-    T value;
-    N next;
+/*
+  same as _iterator, but a second cursor runs Distance nodes ahead of the
+  current one and prefetches every node it reaches, so that the value and
+  the link of a node are already on their way to the cache when the
+  iterator gets there. the cursor itself still has to follow the links
+  one by one: the gain comes from overlapping the misses on the values
+  (and the work done on them) with the misses on the links.
+  the pool must provide prefetch(x); address 0 is the end of every stack.
+*/
+template <typename stack_pool, typename T, typename N = std::size_t, std::size_t Distance = 4>
+class _prefetch_iterator {
+  stack_pool* p;
+  N stack_index;
+  N ahead;
+public:
+    using value_type = T;
+    using reference = value_type&;
+    using pointer = value_type*;
+    using difference_type = std::ptrdiff_t;
+    using iterator_category = std::forward_iterator_tag;
+
+    _prefetch_iterator(stack_pool* pool, N x) : p{pool}, stack_index{x}, ahead{x} {
+      for (std::size_t i = 0; i < Distance && ahead != N(0); ++i)
+        ahead = p->next(ahead);
+      if (ahead != N(0))
+        p->prefetch(ahead);
+    }
+    reference operator*() const { return p->value(stack_index); }
+
+    _prefetch_iterator& operator++() {
+      stack_index = p->next(stack_index);
+      if (ahead != N(0)) {
+        ahead = p->next(ahead);
+        if (ahead != N(0))
+          p->prefetch(ahead);
+      }
+      return *this;
+    }
+
+    _prefetch_iterator operator++(int) {
+      auto tmp = *this;
+      ++(*this);
+      return tmp;
+    }
+
+    friend bool operator==(const _prefetch_iterator& x, const _prefetch_iterator& y) {
+      return (x.stack_index == y.stack_index );
+    }
+
+    friend bool operator!=(const _prefetch_iterator& x, const _prefetch_iterator& y) {
+      return !(x==y);
+    }
+};
+
+/*
+  layouts decide how the nodes are stored in memory. each one provides
+  a storage class template, taking the allocator of the pool (rebound
+  to whatever it allocates), holding the nodes in positions 0, 1, ...
+  (the pool converts addresses to positions) with the same interface:
+  value(i), next(i), prefetch(i), construct(i, args...), destroy(i),
+  emplace_back(next, args...), append(first, last, head),
+  append_n(n, value, head), size, capacity, reserve(n, live), truncate(n),
+  shrink_to_fit(live), clear(live), copy_from(other, live) and
+  move_assign(other, make_live).
+
+  a value exists only while its node is in a stack: the slots of free
+  nodes hold raw memory. the storage does not know which nodes are free,
+  so whatever has to visit every value (moving the nodes to a larger
+  buffer, copying, destroying) takes a predicate live(i) from the pool.
+  nodes are appended only when there are no free ones, so growing on
+  emplace_back, append and append_n treats every node as live. truncate
+  drops nodes that are all free, and the storage itself never destroys
+  a value: its destructor only gives back the memory.
+*/
+
+// the live predicate of a storage whose nodes are all in some stack
+struct _all_live {
+  bool operator()(std::size_t) const noexcept { return true; }
+};
+
+/*
+  call make(i) for every live node i < n, building its value: if one
+  of them throws, the values already built are destroyed with destroy(i)
+  before the exception goes on.
+*/
+template <typename Live, typename Make, typename Destroy>
+void _build_live(std::size_t n, const Live& live, Make make, Destroy destroy) {
+  std::size_t i = 0;
+  try {
+    for (; i < n; ++i)
+      if (live(i))
+        make(i);
+  } catch (...) {
+    while (i-- > 0)
+      if (live(i))
+        destroy(i);
+    throw;
+  }
+}
+
+// a node whose value is constructed and destroyed by the storage, not by the node
+template <typename T, typename N>
+struct _node {
+  union { T value; };
+  N next;
+  explicit _node(N n) noexcept : next{n} {}
+  ~_node() {}
+};
+
+/*
+  array of structures: value and next of a node are stored together,
+  which is the best choice when a traversal reads every value.
+*/
+struct aos_layout {
+  template <typename T, typename N, typename Allocator>
+  class storage {
+    using node_t = _node<T, N>;
+    using allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<node_t>;
+    using traits = std::allocator_traits<allocator_type>;
+
+    public:
+    using size_type = std::size_t;
+
+    private:
+    allocator_type alloc;
+    node_t* nodes = nullptr;
+    size_type n_nodes = 0;
+    size_type n_alloc = 0;
+
+    /*
+      build in dst the first n nodes of src, each live value taken
+      with get (a copy or a move). values that can be copied as bytes
+      are copied with the links, whether they are live or not.
+    */
+    template <typename Src, typename Live, typename Get>
+    static void build(node_t* dst, Src* src, size_type n, const Live& live, Get get) {
+      if (std::is_trivially_copyable<T>::value) {
+        if (n != 0)  // src is null for an empty storage
+          std::memcpy(static_cast<void*>(dst), static_cast<const void*>(src), n * sizeof(node_t));
+        return;
+      }
+      for (size_type i = 0; i < n; ++i)
+        ::new (static_cast<void*>(dst + i)) node_t{src[i].next};
+      _build_live(n, live,
+                  [dst, src, &get](size_type i) { ::new (static_cast<void*>(&dst[i].value)) T(get(src[i].value)); },
+                  [dst](size_type i) { dst[i].value.~T(); });
+    }
+
+    template <typename Live>
+    static void destroy_live(node_t* p, size_type n, const Live& live) noexcept {
+      if (!std::is_trivially_destructible<T>::value)
+        for (size_type i = 0; i < n; ++i)
+          if (live(i))
+            p[i].value.~T();
+    }
+
+    static decltype(auto) relocated(T& v) noexcept { return std::move_if_noexcept(v); }
+
+    void deallocate() noexcept {
+      if (nodes != nullptr)
+        traits::deallocate(alloc, nodes, n_alloc);
+      nodes = nullptr;
+      n_alloc = 0;
+    }
+
+    // use p, a buffer of c nodes where the nodes have been moved
+    template <typename Live>
+    void adopt(node_t* p, size_type c, const Live& live) noexcept {
+      destroy_live(nodes, n_nodes, live);
+      deallocate();
+      nodes = p;
+      n_alloc = c;
+    }
+
+    // move the nodes to p, a new buffer of c nodes
+    template <typename Live>
+    void move_to(node_t* p, size_type c, const Live& live) {
+      try {
+        build(p, nodes, n_nodes, live, relocated);
+      } catch (...) {
+        traits::deallocate(alloc, p, c);
+        throw;
+      }
+      adopt(p, c, live);
+    }
+
+    /*
+      move to a buffer of c nodes, appending a node built from args: the
+      new value is constructed first, since args may refer to a value
+      of this storage.
+    */
+    template <typename... Args>
+    void grow_back(size_type c, N next, Args&&... args) {
+      node_t* p = traits::allocate(alloc, c);
+      ::new (static_cast<void*>(p + n_nodes)) node_t{next};
+      try {
+        ::new (static_cast<void*>(&p[n_nodes].value)) T(std::forward<Args>(args)...);
+      } catch (...) {
+        traits::deallocate(alloc, p, c);
+        throw;
+      }
+      try {
+        build(p, nodes, n_nodes, _all_live{}, relocated);
+      } catch (...) {
+        p[n_nodes].value.~T();
+        traits::deallocate(alloc, p, c);
+        throw;
+      }
+      adopt(p, c, _all_live{});
+      ++n_nodes;
+    }
+
+    template <typename... Args>
+    void construct_back(N next, Args&&... args) {
+      ::new (static_cast<void*>(nodes + n_nodes)) node_t{next};
+      construct(n_nodes, std::forward<Args>(args)...);
+      ++n_nodes;
+    }
+
+    public:
+    storage() = default;
+    explicit storage(const Allocator& a) : alloc(a) {}
+    storage(storage&& other) noexcept
+        : alloc{std::move(other.alloc)}, nodes{other.nodes}, n_nodes{other.n_nodes}, n_alloc{other.n_alloc} {
+      other.nodes = nullptr;
+      other.n_nodes = other.n_alloc = 0;
+    }
+    storage(const storage&) = delete;
+    storage& operator=(const storage&) = delete;
+    ~storage() noexcept { deallocate(); }
+
+    Allocator get_allocator() const { return Allocator(alloc); }
+
+    T& value(size_type i) noexcept { return nodes[i].value; }
+    const T& value(size_type i) const noexcept { return nodes[i].value; }
+    N& next(size_type i) noexcept { return nodes[i].next; }
+    const N& next(size_type i) const noexcept { return nodes[i].next; }
+    void prefetch(size_type i) const noexcept { __builtin_prefetch(nodes + i); }
+
+    template <typename... Args>
+    void construct(size_type i, Args&&... args) {
+      ::new (static_cast<void*>(&nodes[i].value)) T(std::forward<Args>(args)...);
+    }
+    void destroy(size_type i) noexcept { nodes[i].value.~T(); }
+
+    template <typename... Args>
+    void emplace_back(N next, Args&&... args) {
+      if (n_nodes < n_alloc)
+        construct_back(next, std::forward<Args>(args)...);
+      else
+        grow_back(std::max(size_type(1), 2 * n_alloc), next, std::forward<Args>(args)...);
+    }
+
+    /*
+      append the values in [first, last) as a chain of new nodes, each
+      one linked to the previous and the first one linked to head.
+    */
+    template <typename I>
+    void append(I first, I last, N head) {
+      const size_type n = std::distance(first, last);
+      if (n_nodes + n > n_alloc)
+        reserve(std::max(n_nodes + n, 2 * n_alloc), _all_live{});
+      for (; first != last; ++first) {
+        construct_back(head, *first);
+        head = N(n_nodes);
+      }
+    }
+
+    void append_n(size_type n, const T& val, N head) {
+      if (n == 0)
+        return;
+      const T* v = &val;
+      if (n_nodes + n > n_alloc) {
+        grow_back(std::max(n_nodes + n, 2 * n_alloc), head, val);
+        v = &nodes[n_nodes - 1].value;  // val may have been moved with the nodes
+        head = N(n_nodes);
+        --n;
+      }
+      for (; n > 0; --n) {
+        construct_back(head, *v);
+        head = N(n_nodes);
+      }
+    }
+
+    size_type size() const noexcept { return n_nodes; }
+    size_type capacity() const noexcept { return n_alloc; }
+
+    template <typename Live>
+    void reserve(size_type n, const Live& live) {
+      if (n > n_alloc)
+        move_to(traits::allocate(alloc, n), n, live);
+    }
+
+    void truncate(size_type n) noexcept { n_nodes = n; }
+
+    template <typename Live>
+    void shrink_to_fit(const Live& live) {
+      if (n_nodes == 0)
+        deallocate();
+      else if (n_nodes < n_alloc)
+        move_to(traits::allocate(alloc, n_nodes), n_nodes, live);
+    }
+
+    template <typename Live>
+    void clear(const Live& live) noexcept {
+      destroy_live(nodes, n_nodes, live);
+      n_nodes = 0;
+    }
+
+    // this storage must be empty
+    template <typename Live>
+    void copy_from(const storage& other, const Live& live) {
+      reserve(other.n_nodes, live);
+      build(nodes, other.nodes, other.n_nodes, live, [](const T& v) -> const T& { return v; });
+      n_nodes = other.n_nodes;
+    }
+
+    /*
+      this storage must hold no value. the nodes of other are taken as
+      they are when the allocators allow it, otherwise they are moved one
+      by one, and only then make_live() is called.
+    */
+    template <typename MakeLive>
+    void move_assign(storage&& other, MakeLive make_live) {
+      if (traits::propagate_on_container_move_assignment::value || alloc == other.alloc) {
+        deallocate();
+        if (traits::propagate_on_container_move_assignment::value)
+          alloc = std::move(other.alloc);
+        nodes = other.nodes;
+        n_nodes = other.n_nodes;
+        n_alloc = other.n_alloc;
+        other.nodes = nullptr;
+        other.n_nodes = other.n_alloc = 0;
+      } else {
+        const auto live = make_live();
+        n_nodes = 0;
+        reserve(other.n_nodes, _all_live{});
+        build(nodes, other.nodes, other.n_nodes, live, [](T& v) -> T&& { return std::move(v); });
+        n_nodes = other.n_nodes;
+        other.clear(live);
+        other.deallocate();
+      }
+    }
+  };
+};
+
+/*
+  structure of arrays: values and links live in two separate arrays.
+  no padding is wasted when T is smaller than N, and a traversal that
+  only follows the links (e.g. looking for the tail of a stack) does
+  not pull the values into the cache.
+*/
+struct soa_layout {
+  template <typename T, typename N, typename Allocator>
+  class storage {
+    using value_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+    using next_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<N>;
+    using traits = std::allocator_traits<value_allocator>;
+
+    public:
+    using size_type = std::size_t;
+
+    private:
+    value_allocator alloc;
+    T* values = nullptr;
+    size_type n_alloc = 0;
+    std::vector<N, next_allocator> nexts;  // its size is the number of nodes
+
+    template <typename Src, typename Live, typename Get>
+    static void build(T* dst, Src* src, size_type n, const Live& live, Get get) {
+      if (std::is_trivially_copyable<T>::value) {
+        if (n != 0)  // src is null for an empty storage
+          std::memcpy(static_cast<void*>(dst), static_cast<const void*>(src), n * sizeof(T));
+        return;
+      }
+      _build_live(n, live,
+                  [dst, src, &get](size_type i) { ::new (static_cast<void*>(dst + i)) T(get(src[i])); },
+                  [dst](size_type i) { dst[i].~T(); });
+    }
+
+    template <typename Live>
+    static void destroy_live(T* p, size_type n, const Live& live) noexcept {
+      if (!std::is_trivially_destructible<T>::value)
+        for (size_type i = 0; i < n; ++i)
+          if (live(i))
+            p[i].~T();
+    }
+
+    static decltype(auto) relocated(T& v) noexcept { return std::move_if_noexcept(v); }
+
+    void deallocate() noexcept {
+      if (values != nullptr)
+        traits::deallocate(alloc, values, n_alloc);
+      values = nullptr;
+      n_alloc = 0;
+    }
+
+    // use p, an array of c values where the values have been moved
+    template <typename Live>
+    void adopt(T* p, size_type c, const Live& live) noexcept {
+      destroy_live(values, size(), live);
+      deallocate();
+      values = p;
+      n_alloc = c;
+    }
+
+    // move the values to p, a new array of c values
+    template <typename Live>
+    void move_to(T* p, size_type c, const Live& live) {
+      try {
+        nexts.reserve(c);
+        build(p, values, size(), live, relocated);
+      } catch (...) {
+        traits::deallocate(alloc, p, c);
+        throw;
+      }
+      adopt(p, c, live);
+    }
+
+    // as in aos_layout, the new value is built before the others are moved
+    template <typename... Args>
+    void grow_back(size_type c, N next, Args&&... args) {
+      const size_type n = size();
+      nexts.reserve(c);
+      T* p = traits::allocate(alloc, c);
+      try {
+        ::new (static_cast<void*>(p + n)) T(std::forward<Args>(args)...);
+      } catch (...) {
+        traits::deallocate(alloc, p, c);
+        throw;
+      }
+      try {
+        build(p, values, n, _all_live{}, relocated);
+      } catch (...) {
+        p[n].~T();
+        traits::deallocate(alloc, p, c);
+        throw;
+      }
+      adopt(p, c, _all_live{});
+      nexts.push_back(next);  // there is room for it
+    }
+
+    template <typename... Args>
+    void construct_back(N next, Args&&... args) {
+      construct(size(), std::forward<Args>(args)...);
+      try {
+        nexts.push_back(next);
+      } catch (...) {
+        destroy(size());
+        throw;
+      }
+    }
+
+    public:
+    storage() = default;
+    explicit storage(const Allocator& a) : alloc(a), nexts{next_allocator(a)} {}
+    storage(storage&& other) noexcept
+        : alloc{std::move(other.alloc)}, values{other.values}, n_alloc{other.n_alloc}, nexts{std::move(other.nexts)} {
+      other.values = nullptr;
+      other.n_alloc = 0;
+      other.nexts.clear();
+    }
+    storage(const storage&) = delete;
+    storage& operator=(const storage&) = delete;
+    ~storage() noexcept { deallocate(); }
+
+    Allocator get_allocator() const { return Allocator(alloc); }
+
+    T& value(size_type i) noexcept { return values[i]; }
+    const T& value(size_type i) const noexcept { return values[i]; }
+    N& next(size_type i) noexcept { return nexts[i]; }
+    const N& next(size_type i) const noexcept { return nexts[i]; }
+    void prefetch(size_type i) const noexcept {
+      __builtin_prefetch(values + i);
+      __builtin_prefetch(&nexts[i]);
+    }
+
+    template <typename... Args>
+    void construct(size_type i, Args&&... args) {
+      ::new (static_cast<void*>(values + i)) T(std::forward<Args>(args)...);
+    }
+    void destroy(size_type i) noexcept { values[i].~T(); }
+
+    template <typename... Args>
+    void emplace_back(N next, Args&&... args) {
+      if (size() < n_alloc)
+        construct_back(next, std::forward<Args>(args)...);
+      else
+        grow_back(std::max(size_type(1), 2 * n_alloc), next, std::forward<Args>(args)...);
+    }
+
+    /*
+      here the new values are contiguous, so they are copied with a
+      single uninitialized copy (a memmove when T is trivially copyable)
+      and the links are just the consecutive addresses.
+    */
+    template <typename I>
+    void append(I first, I last, N head) {
+      const size_type n = std::distance(first, last);
+      if (size() + n > n_alloc)
+        reserve(std::max(size() + n, 2 * n_alloc), _all_live{});
+      std::uninitialized_copy(first, last, values + size());
+      link(n, head);
+    }
+
+    void append_n(size_type n, const T& val, N head) {
+      if (n == 0)
+        return;
+      if (size() + n > n_alloc) {
+        grow_back(std::max(size() + n, 2 * n_alloc), head, val);
+        head = N(size());
+        --n;
+        std::uninitialized_fill_n(values + size(), n, values[size() - 1]);  // val may have been moved
+      } else {
+        std::uninitialized_fill_n(values + size(), n, val);
+      }
+      link(n, head);
+    }
+
+    size_type size() const noexcept { return nexts.size(); }
+    size_type capacity() const noexcept { return n_alloc; }
+
+    template <typename Live>
+    void reserve(size_type n, const Live& live) {
+      if (n > n_alloc)
+        move_to(traits::allocate(alloc, n), n, live);
+    }
+
+    void truncate(size_type n) noexcept { nexts.erase(nexts.begin() + n, nexts.end()); }
+
+    template <typename Live>
+    void shrink_to_fit(const Live& live) {
+      if (size() == 0)
+        deallocate();
+      else if (size() < n_alloc)
+        move_to(traits::allocate(alloc, size()), size(), live);
+      nexts.shrink_to_fit();
+    }
+
+    template <typename Live>
+    void clear(const Live& live) noexcept {
+      destroy_live(values, size(), live);
+      nexts.clear();
+    }
+
+    template <typename Live>
+    void copy_from(const storage& other, const Live& live) {
+      reserve(other.size(), live);
+      build(values, other.values, other.size(), live, [](const T& v) -> const T& { return v; });
+      nexts = other.nexts;
+    }
+
+    template <typename MakeLive>
+    void move_assign(storage&& other, MakeLive make_live) {
+      if (traits::propagate_on_container_move_assignment::value || alloc == other.alloc) {
+        deallocate();
+        if (traits::propagate_on_container_move_assignment::value)
+          alloc = std::move(other.alloc);
+        values = other.values;
+        n_alloc = other.n_alloc;
+        nexts = std::move(other.nexts);
+        other.values = nullptr;
+        other.n_alloc = 0;
+        other.nexts.clear();
+      } else {
+        const auto live = make_live();
+        nexts.clear();
+        reserve(other.size(), _all_live{});
+        build(values, other.values, other.size(), live, [](T& v) -> T&& { return std::move(v); });
+        nexts = std::move(other.nexts);
+        other.clear(live);
+        other.deallocate();
+      }
+    }
+
+    private:
+    void link(size_type n, N head) {
+      if (n == 0)
+        return;
+      const size_type base = nexts.size();
+      nexts.push_back(head);
+      for (size_type i = 1; i < n; ++i)
+        nexts.push_back(N(base + i));
+    }
   };
-  std::vector<node_t> pool;
-  using stack_type = N;
+};
+
+/*
+  segmented storage: nodes live in chunks of 2^ChunkBits nodes, the
+  high bits of a position select the chunk and the low bits the node.
+  growing the pool allocates one more chunk and never moves the nodes
+  already stored, so push has no latency spikes proportional to the
+  size of the pool and the references returned by value() stay valid.
+*/
+template <unsigned ChunkBits = 12>
+struct segmented_layout {
+  template <typename T, typename N, typename Allocator>
+  class storage {
+    using node_t = _node<T, N>;
+    using allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<node_t>;
+    using traits = std::allocator_traits<allocator_type>;
+
+    public:
+    using size_type = std::size_t;
+
+    private:
+    static constexpr size_type chunk_size = size_type(1) << ChunkBits;
+    static constexpr size_type mask = chunk_size - 1;
+
+    std::vector<node_t*> chunks;
+    size_type n_nodes = 0;
+    allocator_type alloc;
+
+    node_t& node(size_type i) noexcept { return chunks[i >> ChunkBits][i & mask]; }
+    const node_t& node(size_type i) const noexcept { return chunks[i >> ChunkBits][i & mask]; }
+
+    void release() noexcept {
+      for (auto c : chunks)
+        traits::deallocate(alloc, c, chunk_size);
+      chunks.clear();
+      n_nodes = 0;
+    }
+
+    // build the nodes of other here, each live value taken with get
+    template <typename Src, typename Live, typename Get>
+    void build(Src& other, const Live& live, Get get) {
+      reserve(other.size(), _all_live{});
+      for (size_type i = 0; i < other.size(); ++i)
+        ::new (static_cast<void*>(&node(i))) node_t{other.next(i)};
+      _build_live(other.size(), live,
+                  [this, &other, &get](size_type i) { construct(i, get(other.value(i))); },
+                  [this](size_type i) { destroy(i); });
+      n_nodes = other.size();
+    }
+
+    public:
+    storage() = default;
+    explicit storage(const Allocator& a) : alloc(a) {}
+    storage(storage&& other) noexcept
+        : chunks{std::move(other.chunks)}, n_nodes{other.n_nodes}, alloc{std::move(other.alloc)} {
+      other.chunks.clear();
+      other.n_nodes = 0;
+    }
+    storage(const storage&) = delete;
+    storage& operator=(const storage&) = delete;
+    ~storage() noexcept { release(); }
+
+    Allocator get_allocator() const { return Allocator(alloc); }
+
+    T& value(size_type i) noexcept { return node(i).value; }
+    const T& value(size_type i) const noexcept { return node(i).value; }
+    N& next(size_type i) noexcept { return node(i).next; }
+    const N& next(size_type i) const noexcept { return node(i).next; }
+    void prefetch(size_type i) const noexcept { __builtin_prefetch(&node(i)); }
+
+    template <typename... Args>
+    void construct(size_type i, Args&&... args) {
+      ::new (static_cast<void*>(&node(i).value)) T(std::forward<Args>(args)...);
+    }
+    void destroy(size_type i) noexcept { node(i).value.~T(); }
+
+    template <typename... Args>
+    void emplace_back(N next, Args&&... args) {
+      if (n_nodes == capacity())
+        chunks.push_back(traits::allocate(alloc, chunk_size));
+      ::new (static_cast<void*>(&node(n_nodes))) node_t{next};
+      construct(n_nodes, std::forward<Args>(args)...);
+      ++n_nodes;
+    }
+
+    template <typename I>
+    void append(I first, I last, N head) {
+      for (; first != last; ++first) {
+        emplace_back(head, *first);
+        head = N(n_nodes);
+      }
+    }
+
+    void append_n(size_type n, const T& val, N head) {
+      for (; n > 0; --n) {
+        emplace_back(head, val);
+        head = N(n_nodes);
+      }
+    }
+
+    size_type size() const noexcept { return n_nodes; }
+    size_type capacity() const noexcept { return chunks.size() * chunk_size; }
+
+    // nodes never move here, so the live predicates are not needed
+    template <typename Live>
+    void reserve(size_type n, const Live&) {
+      while (capacity() < n)
+        chunks.push_back(traits::allocate(alloc, chunk_size));
+    }
+
+    void truncate(size_type n) noexcept { n_nodes = n; }
+
+    template <typename Live>
+    void shrink_to_fit(const Live&) {
+      const size_type used = (n_nodes + mask) >> ChunkBits;
+      for (size_type c = used; c < chunks.size(); ++c)
+        traits::deallocate(alloc, chunks[c], chunk_size);
+      chunks.resize(used);
+      chunks.shrink_to_fit();
+    }
+
+    template <typename Live>
+    void clear(const Live& live) noexcept {
+      if (!std::is_trivially_destructible<T>::value)
+        for (size_type i = 0; i < n_nodes; ++i)
+          if (live(i))
+            destroy(i);
+      n_nodes = 0;
+    }
+
+    template <typename Live>
+    void copy_from(const storage& other, const Live& live) {
+      build(other, live, [](const T& v) -> const T& { return v; });
+    }
+
+    template <typename MakeLive>
+    void move_assign(storage&& other, MakeLive make_live) {
+      if (traits::propagate_on_container_move_assignment::value || alloc == other.alloc) {
+        release();
+        if (traits::propagate_on_container_move_assignment::value)
+          alloc = std::move(other.alloc);
+        chunks = std::move(other.chunks);
+        n_nodes = other.n_nodes;
+        other.chunks.clear();
+        other.n_nodes = 0;
+      } else {
+        const auto live = make_live();
+        n_nodes = 0;
+        build(other, live, [](T& v) -> T&& { return std::move(v); });
+        other.clear(live);
+        other.release();
+      }
+    }
+  };
+};
+
+/*
+  handles: by default the address of a node is a plain integer N. with
+  N = generational<U, GenBits> it is an unsigned U whose high GenBits
+  bits hold the generation of the node, which goes up every time the
+  node is freed, and whose low bits hold the address, so the pool can
+  hold up to 2^(bits of U - GenBits) - 1 nodes. a handle kept after its
+  node was popped no longer matches the generation of the node: value(),
+  next() and pop() throw stale_handle when they get one, unless the
+  checks are turned off, which is the default when NDEBUG is defined.
+  generations wrap around, so a handle that is stale by a multiple of
+  2^GenBits reuses is not detected.
+*/
+#ifndef STACK_POOL_CHECK_HANDLES
+#ifdef NDEBUG
+#define STACK_POOL_CHECK_HANDLES 0
+#else
+#define STACK_POOL_CHECK_HANDLES 1
+#endif
+#endif
+
+template <typename U, unsigned GenBits = 8>
+struct generational {};
+
+struct stale_handle : std::logic_error {
+  using std::logic_error::logic_error;
+};
+
+template <typename N>
+struct handle_traits {
+  using type = N;
+  static constexpr bool generational = false;
+  static constexpr std::size_t max_index = std::size_t(-1);
+  static constexpr std::size_t index(N x) noexcept { return std::size_t(x); }
+  static constexpr unsigned generation(N) noexcept { return 0; }
+  static constexpr N make(std::size_t i, unsigned) noexcept { return N(i); }
+};
+
+template <typename U, unsigned GenBits>
+struct handle_traits<generational<U, GenBits>> {
+  static_assert(std::is_unsigned<U>::value && GenBits > 0 && GenBits < 8 * sizeof(U),
+                "generational handles need an unsigned type larger than the generation");
+  using type = U;
+  using generation_type = typename std::conditional<
+      (GenBits <= 8), std::uint8_t,
+      typename std::conditional<(GenBits <= 16), std::uint16_t, std::uint32_t>::type>::type;
+  static constexpr bool generational = true;
+  static constexpr unsigned index_bits = 8 * sizeof(U) - GenBits;
+  static constexpr std::size_t max_index = (std::size_t(1) << index_bits) - 1;
+  static constexpr unsigned generation_mask = (1u << GenBits) - 1;
+
+  static constexpr std::size_t index(U x) noexcept { return x & max_index; }
+  static constexpr unsigned generation(U x) noexcept { return unsigned(x >> index_bits); }
+  static constexpr U make(std::size_t i, unsigned g) noexcept { return U(i | (std::size_t(g) << index_bits)); }
+};
+
+/*
+  the generations of the nodes, one per node, kept only by the pools
+  with generational handles: with plain handles there is nothing to store.
+*/
+template <typename Handles, bool = Handles::generational>
+class _generations {
+  public:
+  unsigned generation(std::size_t) const noexcept { return 0; }
+  void next_generation(std::size_t) noexcept {}
+  void prev_generation(std::size_t) noexcept {}
+  unsigned generation_after(std::size_t) const noexcept { return 0; }
+  void next_generations() noexcept {}
+  void grow_generations(std::size_t) {}
+};
+
+template <typename Handles>
+class _generations<Handles, true> {
+  std::vector<typename Handles::generation_type> gens;
+
+  public:
+  unsigned generation(std::size_t i) const noexcept { return gens[i]; }
+  void next_generation(std::size_t i) noexcept {
+    gens[i] = typename Handles::generation_type((gens[i] + 1) & Handles::generation_mask);
+  }
+  void prev_generation(std::size_t i) noexcept {
+    gens[i] = typename Handles::generation_type((gens[i] - 1) & Handles::generation_mask);
+  }
+  unsigned generation_after(std::size_t i) const noexcept { return (gens[i] + 1) & Handles::generation_mask; }
+  // every address ever used moves on, so that no handle taken before matches
+  void next_generations() noexcept {
+    for (auto& g : gens)
+      g = typename Handles::generation_type((g + 1) & Handles::generation_mask);
+  }
+  /*
+    room for at least n nodes, new ones start from generation 0. the
+    table never shrinks: an address cut from the pool keeps its
+    generation, for the handles that may still point to it.
+  */
+  void grow_generations(std::size_t n) {
+    if (n > gens.size())
+      gens.resize(std::max(n, 2 * gens.size()));
+  }
+};
+
+/*
+  the free nodes of a pool whose Reuse policy finds them in the bitmap of
+  the live nodes: how many they are, and the first word of the bitmap
+  that may have one. a pool that links its free nodes keeps nothing.
+*/
+template <bool Bitmap>
+struct _free_bits {
+  std::size_t n_free = 0;
+  std::size_t free_hint = 0;
+
+  _free_bits() = default;
+  _free_bits(const _free_bits&) = default;
+  _free_bits(_free_bits&& other) noexcept
+      : n_free{std::exchange(other.n_free, 0)}, free_hint{std::exchange(other.free_hint, 0)} {}
+  _free_bits& operator=(const _free_bits&) = default;
+  _free_bits& operator=(_free_bits&& other) noexcept {
+    n_free = std::exchange(other.n_free, 0);
+    free_hint = std::exchange(other.free_hint, 0);
+    return *this;
+  }
+};
+
+template <>
+struct _free_bits<false> {};
+
+/*
+  one bit per node of a pool, set while the node holds a value. it can
+  be passed to the storages wherever they need to know the live nodes.
+  bits past the size of the pool are always clear.
+*/
+class _live_bitmap {
+  std::vector<std::uint64_t> words;
+
+  public:
+  static constexpr std::size_t word_bits = 64;
+
+  bool operator()(std::size_t i) const noexcept { return words[i / word_bits] >> (i % word_bits) & 1; }
+  std::uint64_t word(std::size_t w) const noexcept { return words[w]; }
+
+  void set(std::size_t i) noexcept { words[i / word_bits] |= std::uint64_t(1) << (i % word_bits); }
+  void reset(std::size_t i) noexcept { words[i / word_bits] &= ~(std::uint64_t(1) << (i % word_bits)); }
+
+  // set the bits from first to last (excluded)
+  void set(std::size_t first, std::size_t last) noexcept {
+    for (; first < last && first % word_bits != 0; ++first)
+      set(first);
+    for (; first + word_bits <= last; first += word_bits)
+      words[first / word_bits] = ~std::uint64_t(0);
+    for (; first < last; ++first)
+      set(first);
+  }
+
+  // room for n bits, the new ones clear
+  void grow(std::size_t n) {
+    const std::size_t w = (n + word_bits - 1) / word_bits;
+    if (w > words.size())
+      words.resize(std::max(w, 2 * words.size()));
+  }
+
+  // keep only the first n bits
+  void truncate(std::size_t n) {
+    words.resize((n + word_bits - 1) / word_bits);
+    if (n % word_bits != 0)
+      words.back() &= (std::uint64_t(1) << (n % word_bits)) - 1;
+    words.shrink_to_fit();
+  }
+};
+
+/*
+  what stats() reports about a pool. the stack lengths are measured only
+  when stats() is given the heads of the stacks, the other fields are
+  kept up to date by the pool. pops counts every node given back, by pop,
+  pop_n or free_stack, and reused the pushes served by a free node.
+*/
+struct stack_pool_stats {
+  std::size_t live_nodes = 0;
+  std::size_t free_nodes = 0;
+  std::size_t capacity = 0;
+  std::size_t high_water = 0;  // the maximum of live_nodes so far
+  std::size_t reallocations = 0;  // times the storage had to grow
+  std::size_t pushes = 0;
+  std::size_t reused = 0;
+  std::size_t pops = 0;
+  std::size_t stacks = 0;  // stacks sampled
+  double mean_stack_length = 0;
+  std::size_t max_stack_length = 0;
+
+  double reuse_ratio() const noexcept {
+    return pushes == 0 ? 0 : double(reused) / double(pushes);
+  }
+};
+
+// one "name: value" line per field
+inline std::ostream& operator<<(std::ostream& os, const stack_pool_stats& s) {
+  return os << "live nodes: " << s.live_nodes << '\n'
+            << "free nodes: " << s.free_nodes << '\n'
+            << "capacity: " << s.capacity << '\n'
+            << "high water: " << s.high_water << '\n'
+            << "reallocations: " << s.reallocations << '\n'
+            << "pushes: " << s.pushes << '\n'
+            << "reused: " << s.reused << '\n'
+            << "reuse ratio: " << s.reuse_ratio() << '\n'
+            << "pops: " << s.pops << '\n'
+            << "stacks: " << s.stacks << '\n'
+            << "mean stack length: " << s.mean_stack_length << '\n'
+            << "max stack length: " << s.max_stack_length << '\n';
+}
+
+inline std::string to_json(const stack_pool_stats& s) {
+  auto field = [](const char* name, const std::string& value) {
+    return std::string{"\""} + name + "\": " + value;
+  };
+  using std::to_string;
+  return "{" + field("live_nodes", to_string(s.live_nodes)) + ", " +
+         field("free_nodes", to_string(s.free_nodes)) + ", " +
+         field("capacity", to_string(s.capacity)) + ", " +
+         field("high_water", to_string(s.high_water)) + ", " +
+         field("reallocations", to_string(s.reallocations)) + ", " +
+         field("pushes", to_string(s.pushes)) + ", " +
+         field("reused", to_string(s.reused)) + ", " +
+         field("reuse_ratio", to_string(s.reuse_ratio())) + ", " +
+         field("pops", to_string(s.pops)) + ", " +
+         field("stacks", to_string(s.stacks)) + ", " +
+         field("mean_stack_length", to_string(s.mean_stack_length)) + ", " +
+         field("max_stack_length", to_string(s.max_stack_length)) + "}";
+}
+
+/*
+  policies for the Stats parameter of stack_pool, which calls their hooks
+  whenever nodes are pushed or given back, and when the storage grows.
+  no_stats, the default, has empty hooks and no data: the pool derives
+  from its policy, so it is neither larger nor slower than without one.
+  count_stats keeps the counters needed by stack_pool::stats().
+*/
+struct no_stats {
+  static constexpr bool enabled = false;
+  void pushed(std::size_t, std::size_t) noexcept {}
+  void freed(std::size_t) noexcept {}
+  void reallocated() noexcept {}
+  void reset(std::size_t, std::size_t) noexcept {}
+};
+
+struct count_stats {
+  static constexpr bool enabled = true;
+
+  // fresh nodes were appended to the pool and reused ones taken from the free list
+  void pushed(std::size_t fresh, std::size_t reused) noexcept {
+    counters.pushes += fresh + reused;
+    counters.reused += reused;
+    counters.live_nodes += fresh + reused;
+    counters.free_nodes -= reused;
+    counters.high_water = std::max(counters.high_water, counters.live_nodes);
+  }
+
+  void freed(std::size_t n) noexcept {
+    counters.pops += n;
+    counters.live_nodes -= n;
+    counters.free_nodes += n;
+  }
+
+  void reallocated() noexcept { ++counters.reallocations; }
+
+  // the nodes were rearranged (compact, shrink_to_fit, load)
+  void reset(std::size_t live, std::size_t free) noexcept {
+    counters.live_nodes = live;
+    counters.free_nodes = free;
+    counters.high_water = std::max(counters.high_water, live);
+  }
+
+  const stack_pool_stats& get() const noexcept { return counters; }
+
+ private:
+  stack_pool_stats counters;
+};
+
+/*
+  policies for the Reuse parameter of stack_pool, which decide the free
+  node taken by a push. lifo_reuse, the default, takes the last node
+  given back, from the list linked through the free nodes: it costs
+  nothing, but after a long churn the nodes of a new stack come from
+  anywhere in the pool, and walking it jumps all over the memory.
+  the other policies keep no list: the free nodes are the clear bits of
+  the bitmap of the live ones, among the first size, and pick chooses
+  one of them (there is at least one). hint is the first word of the
+  bitmap that may have a clear bit, head the position of the node on
+  top of the stack, or no_head for an empty stack.
+  with them, freeing a stack through its descriptor walks it, to clear
+  its bits.
+*/
+struct lifo_reuse {
+  static constexpr bool bitmap = false;
+};
+
+/*
+  the free node with the lowest address, with a find-first-set on the
+  words of the bitmap: the live nodes stay packed at the start of the
+  pool, and pushes after a pop_n or a free_stack get adjacent nodes.
+*/
+struct lowest_address_reuse {
+  static constexpr bool bitmap = true;
+  static constexpr std::size_t no_head = std::size_t(-1);
+
+  static std::size_t pick(const _live_bitmap& live, std::size_t, std::size_t& hint, std::size_t) noexcept {
+    while (live.word(hint) == ~std::uint64_t(0))
+      ++hint;
+    return hint * _live_bitmap::word_bits + __builtin_ctzll(~live.word(hint));
+  }
+};
+
+/*
+  the free node closest to the head of the stack, looking at the word of
+  the bitmap of the head and at window words on each side (512 nodes
+  each), so that a walk of the stack moves little from a node to the one
+  below. an empty stack, or a head with no free node around it, gets
+  the lowest address instead.
+*/
+struct nearest_head_reuse {
+  static constexpr bool bitmap = true;
+  static constexpr std::size_t no_head = std::size_t(-1);
+  static constexpr std::size_t window = 8;
+
+  static std::size_t pick(const _live_bitmap& live, std::size_t size, std::size_t& hint, std::size_t head) noexcept {
+    constexpr std::size_t bits = _live_bitmap::word_bits;
+    if (head != no_head) {
+      const std::size_t w = head / bits;
+      const std::size_t b = head % bits;
+      const std::size_t last = (size - 1) / bits;
+      std::uint64_t free = free_in(live, size, w);
+      if (free != 0) {
+        const std::uint64_t above = free >> b;
+        const std::uint64_t below = free & ((std::uint64_t(1) << b) - 1);
+        const std::size_t up = above == 0 ? bits : __builtin_ctzll(above);
+        const std::size_t down = below == 0 ? bits : b - (bits - 1 - __builtin_clzll(below));
+        return up <= down ? head + up : head - down;
+      }
+      for (std::size_t d = 1; d <= window; ++d) {
+        if (w >= d && (free = free_in(live, size, w - d)) != 0)
+          return (w - d) * bits + bits - 1 - __builtin_clzll(free);
+        if (w + d <= last && (free = free_in(live, size, w + d)) != 0)
+          return (w + d) * bits + __builtin_ctzll(free);
+      }
+    }
+    return lowest_address_reuse::pick(live, size, hint, head);
+  }
+
+ private:
+  // the free nodes among the bits of word w
+  static std::uint64_t free_in(const _live_bitmap& live, std::size_t size, std::size_t w) noexcept {
+    std::uint64_t free = ~live.word(w);
+    if ((w + 1) * _live_bitmap::word_bits > size)
+      free &= (std::uint64_t(1) << (size % _live_bitmap::word_bits)) - 1;
+    return free;
+  }
+};
+
+/*
+  the Allocator is used for all the memory of the pool: each layout
+  rebinds it to the types it stores (nodes, values or links).
+  the Stats policy (no_stats or count_stats) decides whether the pool
+  keeps the counters returned by stats(), the Reuse policy (lifo_reuse,
+  lowest_address_reuse or nearest_head_reuse) which free node a push
+  takes, and N can be a plain integer or generational<U, GenBits>
+  (see handle_traits).
+*/
+template <typename T, typename N = std::size_t, typename Layout = aos_layout, typename Allocator = std::allocator<T>, typename Stats = no_stats, typename Reuse = lifo_reuse>
+class stack_pool : private Stats, private _generations<handle_traits<N>>, private _free_bits<Reuse::bitmap> {
+  using handles = handle_traits<N>;
+  using stack_type = typename handles::type;
+  using storage_type = typename Layout::template storage<T, stack_type, Allocator>;
+  storage_type pool;
   using value_type = T;
-  using size_type = typename std::vector<node_t>::size_type;
-  stack_type free_nodes; // at the beginning, it is empty
-  
-  node_t& node(stack_type x) noexcept { return pool[x-1]; } // node which has index 1 is actually stored at position zero and so on
-  const node_t& node(stack_type x) const noexcept { return pool[x-1]; }
+  using size_type = typename storage_type::size_type;
+  stack_type free_nodes; // at the beginning, it is empty (and always, with a bitmap Reuse policy)
+  /*
+    the nodes holding a value, kept up to date by push and pop. freeing a
+    stack through its descriptor does not walk it, when it would walk
+    only to clear bits: live_exact is then false until the nodes are
+    rearranged, and the bitmap is rebuilt from the free list when needed.
+  */
+  _live_bitmap live_bits;
+  bool live_exact = true;
 
+  /*
+    while a checkpoint is open, the nodes below undo_below (those that
+    existed when the latest checkpoint was taken) are not changed without
+    writing in undo_log what rollback needs to restore them.
+  */
+  struct undo_entry {
+    size_type what;  // the position of the node, shifted left by 2, and the kind of change
+    stack_type link;  // the link of the node before the change
+  };
+  std::vector<undo_entry> undo_log;
+  size_type undo_below = 0;
+  size_type open_checkpoints = 0;
+  
   public:
   stack_pool() : free_nodes{end()} {};
-  explicit stack_pool(size_type n) : free_nodes{end()} { pool.reserve(n); }; // reserve n nodes in the pool
-   ~stack_pool() noexcept = default;
+  explicit stack_pool(size_type n) : free_nodes{end()} { reserve_nodes(n); }; // reserve n nodes in the pool
+  explicit stack_pool(const Allocator& a) : pool{a}, free_nodes{end()} {};
+  stack_pool(size_type n, const Allocator& a) : pool{a}, free_nodes{end()} { reserve_nodes(n); };
+
+  /*
+    free nodes hold no value, so copying, moving and destroying a pool
+    need to know which nodes are free: the bitmap of the live ones says it.
+  */
+  stack_pool(const stack_pool& other)
+      : Stats(other),
+        _generations<handles>(other),
+        _free_bits<Reuse::bitmap>(other),
+        pool{std::allocator_traits<Allocator>::select_on_container_copy_construction(other.get_allocator())},
+        free_nodes{other.free_nodes},
+        live_bits{other.live()},
+        undo_log{other.undo_log},
+        undo_below{other.undo_below},
+        open_checkpoints{other.open_checkpoints} {
+    pool.copy_from(other.pool, live_bits);
+  }
+
+  stack_pool(stack_pool&& other) noexcept
+      : Stats(other), _generations<handles>(std::move(other)), _free_bits<Reuse::bitmap>(std::move(other)),
+        pool{std::move(other.pool)}, free_nodes{other.free_nodes},
+        live_bits{std::move(other.live_bits)}, live_exact{other.live_exact},
+        undo_log{std::move(other.undo_log)}, undo_below{other.undo_below}, open_checkpoints{other.open_checkpoints} {
+    other.free_nodes = end();
+    other.live_bits = _live_bitmap{};
+    other.live_exact = true;
+    other.undo_log.clear();
+    other.undo_below = 0;
+    other.open_checkpoints = 0;
+  }
+
+  stack_pool& operator=(const stack_pool& other) {
+    if (this != &other)
+      *this = stack_pool(other);
+    return *this;
+  }
+
+  stack_pool& operator=(stack_pool&& other) {
+    if (this != &other) {
+      destroy_values();
+      pool.move_assign(std::move(other.pool), [&other]() { return other.live(); });
+      free_nodes = other.free_nodes;
+      other.free_nodes = end();
+      Stats::operator=(other);
+      _generations<handles>::operator=(std::move(other));
+      _free_bits<Reuse::bitmap>::operator=(std::move(other));
+      live_bits = std::move(other.live_bits);
+      live_exact = other.live_exact;
+      other.live_bits = _live_bitmap{};
+      other.live_exact = true;
+      undo_log = std::move(other.undo_log);
+      undo_below = other.undo_below;
+      open_checkpoints = other.open_checkpoints;
+      other.undo_log.clear();
+      other.undo_below = 0;
+      other.open_checkpoints = 0;
+    }
+    return *this;
+  }
+
+  using allocator_type = Allocator;
+  allocator_type get_allocator() const { return pool.get_allocator(); }
+   ~stack_pool() noexcept { destroy_values(); }
 
   using iterator = _iterator<stack_pool, value_type, stack_type>;
   using const_iterator = _iterator<const stack_pool, const value_type, stack_type>;
@@ -66,12 +1264,70 @@ class stack_pool{
   
   const_iterator cbegin(stack_type x) const {  return const_iterator{this,x}; }
   const_iterator cend(stack_type ) const {  return const_iterator{this,end()}; }
+
+  /*
+    iterators prefetching Distance nodes ahead: pool.prefetch_begin<8>(x)
+  */
+  template <std::size_t Distance = 4>
+  using prefetch_iterator = _prefetch_iterator<stack_pool, value_type, stack_type, Distance>;
+  template <std::size_t Distance = 4>
+  using const_prefetch_iterator = _prefetch_iterator<const stack_pool, const value_type, stack_type, Distance>;
+
+  template <std::size_t Distance = 4>
+  prefetch_iterator<Distance> prefetch_begin(stack_type x) { return prefetch_iterator<Distance>{this, x}; }
+  template <std::size_t Distance = 4>
+  prefetch_iterator<Distance> prefetch_end(stack_type ) { return prefetch_iterator<Distance>{this, end()}; }
+  template <std::size_t Distance = 4>
+  const_prefetch_iterator<Distance> prefetch_begin(stack_type x) const { return const_prefetch_iterator<Distance>{this, x}; }
+  template <std::size_t Distance = 4>
+  const_prefetch_iterator<Distance> prefetch_end(stack_type ) const { return const_prefetch_iterator<Distance>{this, end()}; }
+
+  // hint that node x is going to be read soon
+  void prefetch(stack_type x) const noexcept { pool.prefetch(pos(x)); }
     
   stack_type new_stack()  noexcept { stack_type new_stack{0}; return new_stack; }  // return an empty stack
 
-  void reserve(size_type n) { pool.reserve(n); } // reserve n nodes in the pool
+  void reserve(size_type n) { // reserve n nodes in the pool
+    const size_type before = capacity();
+    if (n <= before)
+      return;
+    live_bits.grow(n);
+    if (!has_free(bitmap_reuse{}))
+      pool.reserve(n, _all_live{});
+    else
+      pool.reserve(n, live());
+    this->grow_generations(n);
+    grown(before);
+  }
   size_type capacity() const noexcept { return pool.capacity(); } // the capacity of the pool
 
+  /*
+    the counters kept by the Stats policy, which must be count_stats.
+    given the heads of the stacks in use, their mean and maximum length
+    are measured as well, walking them.
+  */
+  stack_pool_stats stats() const noexcept {
+    static_assert(Stats::enabled, "stats() needs the count_stats policy");
+    stack_pool_stats s = Stats::get();
+    s.capacity = capacity();
+    return s;
+  }
+
+  stack_pool_stats stats(const std::vector<stack_type>& heads) const noexcept(!checked) {
+    stack_pool_stats s = stats();
+    size_type total = 0;
+    for (auto h : heads) {
+      size_type length = 0;
+      for (auto x = h; !empty(x); x = next(x))
+        ++length;
+      total += length;
+      s.max_stack_length = std::max(s.max_stack_length, std::size_t(length));
+    }
+    s.stacks = heads.size();
+    s.mean_stack_length = heads.empty() ? 0 : double(total) / double(heads.size());
+    return s;
+  }
+
   /* 
      check if the stack taken as input is empty by 
      comparing top index and end of the stack, which 
@@ -84,14 +1340,14 @@ class stack_pool{
   /*
     access the inner value of the node at the given index
   */
-  T& value(stack_type x)  noexcept { return node(x).value; }
-  const T& value(stack_type x) const noexcept { return node(x).value; }
+  T& value(stack_type x)  noexcept(!checked) { check(x); return pool.value(pos(x)); } // node which has index 1 is actually stored at position zero and so on
+  const T& value(stack_type x) const noexcept(!checked) { check(x); return pool.value(pos(x)); }
   
   /*
     the following functions are to obtain the index of next node in the stack
   */
-  stack_type& next(stack_type x)  noexcept  { return node(x).next;}
-  const stack_type& next(stack_type x) const  noexcept { return node(x).next;}
+  stack_type& next(stack_type x)  noexcept(!checked)  { check(x); return pool.next(pos(x));}
+  const stack_type& next(stack_type x) const  noexcept(!checked) { check(x); return pool.next(pos(x));}
 
    /*
     the following functions insert a new node on the top of the stack
@@ -99,8 +1355,43 @@ class stack_pool{
     the functions do not control if the index provided is the head of 
     one stack, since doing this would mean to increase class complexity.
   */
-  stack_type push(const T& val, stack_type head)  { return _push(val, head); }
-  stack_type push(T&& val, stack_type head) { return _push(std::move(val),head);}
+  stack_type push(const T& val, stack_type head)  { return _push(head, val); }
+  stack_type push(T&& val, stack_type head) { return _push(head, std::move(val));}
+
+  /*
+    construct the new value in place from args. free nodes hold no value,
+    so reusing one builds the value there, without assigning to an old one.
+  */
+  template <typename... Args>
+  stack_type emplace(stack_type head, Args&&... args) { return _push(head, std::forward<Args>(args)...); }
+
+  /*
+    bulk versions of push: the values are pushed in order, so the last
+    one ends on top of the stack, exactly as with a loop of push.
+    free nodes are used first, then all the remaining values are appended
+    to the pool in one step, reserving memory just once.
+  */
+  template <typename I>
+  stack_type push_range(I first, I last, stack_type head) {
+    using category = typename std::iterator_traits<I>::iterator_category;
+    return _push_range(first, last, head, category{});
+  }
+
+  stack_type push_n(size_type n, const T& val, stack_type head) {
+    for (; n > 0 && has_free(bitmap_reuse{}); --n)
+      head = _reuse(head, val);
+    if (n > 0) {
+      const size_type before = capacity();
+      make_room(n);
+      pool.append_n(n, val, head);
+      live_bits.set(pool.size() - n, pool.size());
+      grown(before);
+      Stats::pushed(n, 0);
+      tag_appended(pool.size() - n);
+      head = handle_at(pool.size() - 1);
+    }
+    return head;
+  }
   
 
   /* 
@@ -108,19 +1399,54 @@ class stack_pool{
     the "stack" of free nodes by using auxiliary function 'free_node'.
     A very simple control is made to check if stack is not empty, otherwise
     the function simply returns the index of the empty stack provided.
+    the value of a node is destroyed when it becomes free, here and in
+    pop_n and free_stack.
   */
-    stack_type pop(stack_type x) noexcept { 
+    stack_type pop(stack_type x) noexcept(!checked) { 
         stack_type head = x;
         if(!empty(x)) { 
           head = next(x);
-          free_nodes = free_node(x, free_nodes);
+          if (pos(x) < undo_below) {
+            retire(x);
+          } else {
+            release(x);
+            give_free(x, x, 1, bitmap_reuse{});
+          }
+          Stats::freed(1);
         }
         return head;
     }
+
+  /*
+    remove the first n nodes of the stack (or all of them, if there are
+    less than n) and move them to the free nodes with a single splice.
+  */
+    stack_type pop_n(stack_type x, size_type n) noexcept(!checked) {
+        if(empty(x) || n == 0)
+          return x;
+        if (undo_below != 0) {
+          for (; n > 0 && !empty(x); --n)
+            x = pop(x);
+          return x;
+        }
+        stack_type last = x;
+        size_type count = 1;
+        for (; n > 1 && !empty(next(last)); --n, ++count) {
+          const stack_type below = next(last);
+          release(last);
+          last = below;
+        }
+        const stack_type head = next(last);
+        release(last);
+        give_free(x, last, count, bitmap_reuse{});
+        Stats::freed(count);
+        return head;
+    }
+
     stack_type free_node(stack_type x, stack_type free)  noexcept {
         stack_type tmp = std::move(free);
         free = std::move(x);
-        next(free) = std::move(tmp);
+        link(free) = std::move(tmp);
         return free;
     }
 
@@ -128,14 +1454,23 @@ class stack_pool{
     this function move all nodes in the given stack to the list
     of free nodes by simply swapping their indexes.
   */
-    stack_type free_stack(stack_type x) noexcept { 
+    stack_type free_stack(stack_type x) noexcept(!checked) { 
+        if (undo_below != 0) {
+          while (!empty(x))
+            x = pop(x);
+          return end();
+        }
         const stack_type start = x;
         const stack_type next_idx = next(x);
-        for (auto it = begin(next_idx); it != end(0); it++) {
-            x = next(x);
+        size_type count = 1;
+        for (auto it = begin(next_idx); it != end(0); it++, ++count) {
+            const stack_type below = next(x);
+            release(x);
+            x = below;
         }
-        next(x) = std::move(free_nodes);
-        free_nodes = std::move(start);
+        release(x);
+        give_free(start, x, count, bitmap_reuse{});
+        Stats::freed(count);
         return end();
     }
 
@@ -146,21 +1481,962 @@ class stack_pool{
         std::cout <<std::endl;
     } 
 
+  /*
+    the following functions only rewire the links of the nodes: nothing
+    is allocated and no value is moved or copied, so handles and
+    references to the values stay valid. those changing two stacks
+    return both new heads: std::tie(a, b) = pool.splice_top(a, b, 3);
+  */
+
+    // reverse the stack, returning its new head (the old bottom)
+    stack_type reverse(stack_type x) noexcept(!checked) {
+        stack_type head = end();
+        while(!empty(x)) {
+            const stack_type below = next(x);
+            log_link(x);
+            next(x) = head;
+            head = x;
+            x = below;
+        }
+        return head;
+    }
+
+  /*
+    cut the stack after its first k nodes: the first returned stack holds
+    them (or all the nodes, if there are less than k), the second one
+    the nodes below, in the same order.
+  */
+    std::pair<stack_type, stack_type> split_at(stack_type x, size_type k) noexcept(!checked) {
+        if(empty(x) || k == 0)
+          return {end(), x};
+        stack_type last = x;
+        for (; k > 1 && !empty(next(last)); --k)
+          last = next(last);
+        const stack_type rest = next(last);
+        log_link(last);
+        next(last) = end();
+        return {x, rest};
+    }
+
+  /*
+    move the first k nodes of from (or all of them) on top of to, keeping
+    their order. returns the new heads of from and to.
+  */
+    std::pair<stack_type, stack_type> splice_top(stack_type from, stack_type to, size_type k) noexcept(!checked) {
+        if(empty(from) || k == 0)
+          return {from, to};
+        stack_type last = from;
+        for (; k > 1 && !empty(next(last)); --k)
+          last = next(last);
+        const stack_type rest = next(last);
+        log_link(last);
+        next(last) = to;
+        return {rest, from};
+    }
+
+  /*
+    merge two stacks sorted by cmp (from the top) into one sorted stack,
+    returning its head. the merge is stable: among equal values those of
+    a come first. a and b must not be used afterwards.
+  */
+    template <typename Compare = std::less<T>>
+    stack_type merge_sorted(stack_type a, stack_type b, Compare cmp = Compare{}) {
+        return _merged(a, b, cmp);
+    }
+
+  /*
+    sort the stack by cmp (the first value on top), returning its new
+    head. it is a bottom-up merge sort: the nodes are taken one by one
+    from the top and carried into bins like the digits of a binary
+    counter, bins[i] holding a sorted run of 2^i nodes, so that runs of
+    equal length are merged as soon as there are two of them. merging
+    the small runs while their nodes are still in cache makes it much
+    faster than doing one pass over the whole stack for each length.
+    only the links change: it needs no memory besides the bins, never
+    moves a value, and is stable.
+  */
+    template <typename Compare = std::less<T>>
+    stack_type sort(stack_type x, Compare cmp = Compare{}) {
+        stack_type bins[8 * sizeof(size_type)];
+        size_type used = 0;
+        while(!empty(x)) {
+            stack_type run = x;
+            x = next(x);
+            log_link(run);
+            next(run) = end();
+            size_type i = 0;
+            for (; i < used && !empty(bins[i]); ++i) {
+                // the nodes in the bins were above those of run
+                run = _merged(bins[i], run, cmp);
+                bins[i] = end();
+            }
+            if(i == used)
+              ++used;
+            bins[i] = run;
+        }
+        stack_type head = end();
+        for (size_type i = 0; i < used; ++i)
+          head = _merged(bins[i], head, cmp);
+        return head;
+    }
+
+  /*
+    queries that do not care about the stacks (a sum, a maximum, how many
+    values match) do not need to follow the links: sweep and reduce_live
+    scan the whole pool in address order, skipping the free nodes with
+    the bitmap of the live ones, and visit every value exactly once.
+  */
+    template <typename F>
+    void sweep(F f) {
+        if(scan_live_bits())
+          _sweep(*this, live_bits, f);
+        else
+          _sweep(*this, in_stacks(), f);
+    }
+    template <typename F>
+    void sweep(F f) const {
+        if(scan_live_bits())
+          _sweep(*this, live_bits, f);
+        else
+          _sweep(*this, in_stacks(), f);
+    }
+
+  /*
+    op(...op(op(init, v1), v2)..., vn) over the live values. when R is T
+    and T is arithmetic, op must be associative and commutative (as +,
+    min and max are): runs of 64 live nodes are then reduced in 8
+    independent lanes, which the compiler turns into vector instructions.
+  */
+    template <typename R, typename Op>
+    R reduce_live(R init, Op op) const {
+        if(scan_live_bits())
+          return _reduce_live(live_bits, std::move(init), op, _lanes<R>{});
+        return _reduce_live(in_stacks(), std::move(init), op, _lanes<R>{});
+    }
+
+  /*
+    how many live values satisfy pred. for arithmetic T the predicate is
+    evaluated on every node of a run of 64, free ones included, and the
+    results are masked with the bitmap, with no branch the compiler
+    could not vectorize.
+  */
+    template <typename Pred>
+    size_type count_live(Pred pred) const {
+        if(scan_live_bits())
+          return _count_live(live_bits, pred);
+        return _count_live(in_stacks(), pred);
+    }
+
+  /*
+    after a long sequence of pushes and pops the nodes of a stack are
+    scattered all over the pool. compact moves the nodes of the given
+    stacks into a new storage, one stack after the other and each one in
+    traversal order, so that following next means reading the following
+    node. the returned vector holds the new heads, in the same order.
+    nodes that cannot be reached from the given heads are discarded,
+    the free list is emptied and the pool keeps just the memory it needs.
+    with generational handles every address moves to its next generation,
+    so that the handles taken before compact are all stale.
+  */
+    std::vector<stack_type> compact(const std::vector<stack_type>& heads) {
+        no_checkpoint("compact");
+        size_type count = 0;
+        for (auto h : heads)
+          for (auto x = h; !empty(x); x = next(x))
+            ++count;
+
+        storage_type compacted{get_allocator()};
+        compacted.reserve(count, _all_live{});
+        _live_bitmap bits;
+        bits.grow(count);
+        bits.set(0, count);
+        std::vector<stack_type> new_heads;
+        new_heads.reserve(heads.size());
+        try {
+            for (auto h : heads) {
+                new_heads.push_back(empty(h) ? end() : compacted_handle(compacted.size()));
+                for (auto x = h; !empty(x); x = next(x)) {
+                    const stack_type link = empty(next(x)) ? end() : compacted_handle(compacted.size() + 1);
+                    compacted.emplace_back(link, std::move(value(x)));
+                }
+            }
+        } catch (...) {
+            compacted.clear(_all_live{});
+            throw;
+        }
+        destroy_values();
+        pool.move_assign(std::move(compacted), []() { return _all_live{}; });
+        free_nodes = end();
+        reset_free(0, bitmap_reuse{});
+        live_bits = std::move(bits);
+        live_exact = true;
+        this->next_generations();
+        Stats::reset(count, 0);
+        return new_heads;
+    }
+
+  /*
+    give back the memory that is not needed: the free nodes at the end
+    of the pool are dropped (the other free nodes keep their order in the
+    free list), then the capacity is reduced to the size of the pool.
+    the generations of the dropped addresses are kept, for the pushes
+    that take them again.
+  */
+    void shrink_to_fit() {
+        no_checkpoint("shrink_to_fit");
+        if (!live_exact) {
+            live_bits = live();
+            live_exact = true;
+        }
+        size_type n = pool.size();
+        while (n > 0 && !live_bits(n - 1))
+          --n;
+
+        const size_type n_free = drop_free(n, bitmap_reuse{});
+        Stats::reset(n - n_free, n_free);
+        pool.truncate(n);
+        live_bits.truncate(n);
+        pool.shrink_to_fit(live_bits);
+    }
+
+  /*
+    a stack descriptor remembers, besides the head of a stack, its last
+    node and its length. the functions taking a descriptor keep them up
+    to date, so that the size of the stack is known in O(1), and freeing
+    or concatenating stacks is a constant time splice instead of a walk
+    looking for the tail (freeing still walks the stack when the values
+    have a destructor to run, or generations to update). as with plain
+    stacks, the updated descriptor is returned: d = pool.push(42, d);
+  */
+    struct stack_descriptor {
+        stack_type head;
+        stack_type tail;
+        size_type size;
+    };
+
+    stack_descriptor new_descriptor() const noexcept { return {end(), end(), 0}; } // an empty stack
+
+    // build the descriptor of an existing stack, walking it once
+    stack_descriptor describe(stack_type x) const noexcept(!checked) {
+        stack_descriptor d{x, x, 0};
+        for (; !empty(x); x = next(x)) {
+            d.tail = x;
+            ++d.size;
+        }
+        return d;
+    }
+
+    iterator begin(const stack_descriptor& d) { return begin(d.head); }
+    iterator end(const stack_descriptor& d) { return end(d.head); }
+    const_iterator begin(const stack_descriptor& d) const { return begin(d.head); }
+    const_iterator end(const stack_descriptor& d) const { return end(d.head); }
+
+    bool empty(const stack_descriptor& d) const noexcept { return empty(d.head); }
+    size_type size(const stack_descriptor& d) const noexcept { return d.size; }
+
+    stack_descriptor push(const T& val, stack_descriptor d) { return _push_descriptor(val, d); }
+    stack_descriptor push(T&& val, stack_descriptor d) { return _push_descriptor(std::move(val), d); }
+
+    stack_descriptor pop(stack_descriptor d) noexcept(!checked) {
+        if(!empty(d)) {
+            d.head = pop(d.head);
+            if(--d.size == 0)
+              d.tail = end();
+        }
+        return d;
+    }
+
+    stack_descriptor free_stack(stack_descriptor d) noexcept(!checked) {
+        if (undo_below != 0)
+          free_stack(d.head);
+        else if(!empty(d)) {
+            if (!std::is_trivially_destructible<T>::value || handles::generational || Reuse::bitmap)
+              for (auto x = d.head; !empty(x); ) {
+                const stack_type below = next(x);
+                release(x);
+                x = below;
+              }
+            else
+              live_exact = false;
+            give_free(d.head, d.tail, d.size, bitmap_reuse{});
+            Stats::freed(d.size);
+        }
+        return new_descriptor();
+    }
+
+  /*
+    link the stack b below the stack a, returning the descriptor of the
+    resulting stack: both a and b must not be used afterwards.
+  */
+    stack_descriptor concat(stack_descriptor a, stack_descriptor b) noexcept(!checked) {
+        if(empty(a))
+          return b;
+        if(!empty(b)) {
+            log_link(a.tail);
+            next(a.tail) = b.head;
+            a.tail = b.tail;
+            a.size += b.size;
+        }
+        return a;
+    }
+
+  /*
+    checkpoints make a batch of changes undoable: after
+      auto cp = pool.checkpoint();
+    the stacks can be changed at will, then either pool.commit(cp) keeps
+    the changes, or pool.rollback(cp) brings every stack and the free
+    nodes back to what they were at the checkpoint. heads and handles
+    taken before the checkpoint are valid again after a rollback, those
+    taken later are not.
+
+    rollback does not look at the whole pool: the nodes pushed since the
+    checkpoint are cut from the end of the pool, and the nodes that were
+    already there are restored from an undo log, which records a node
+    when its link is written and keeps the values of the nodes popped
+    (they are freed only by commit, but their handles are stale and
+    sweep, reduce_live and count_live skip them at once). both take a
+    time proportional to the changes made since the checkpoint.
+
+    checkpoints can be nested, but must be closed in the reverse order
+    they were opened, and compact, shrink_to_fit and load cannot be
+    called while one is open. only the links are logged: values changed
+    in place and links written directly through next() are not restored.
+    the log grows inside functions that are noexcept (pop, reverse, ...):
+    running out of memory there terminates the program.
+  */
+    struct checkpoint_type {
+        size_type size;
+        stack_type free_nodes;
+        size_type log_size;
+        size_type undo_below;  // the one of the enclosing checkpoint
+        size_type depth;
+        bool live_exact;
+        Stats stats;
+        _free_bits<Reuse::bitmap> free_bits;
+    };
+
+    checkpoint_type checkpoint() {
+        checkpoint_type cp{pool.size(), free_nodes, undo_log.size(), undo_below, open_checkpoints + 1,
+                           live_exact, static_cast<const Stats&>(*this),
+                           static_cast<const _free_bits<Reuse::bitmap>&>(*this)};
+        undo_below = pool.size();
+        ++open_checkpoints;
+        return cp;
+    }
+
+    // undo every change made since cp was taken, and close it
+    void rollback(const checkpoint_type& cp) {
+        closing(cp);
+        while (undo_log.size() > cp.log_size) {
+            const undo_entry e = undo_log.back();
+            undo_log.pop_back();
+            const size_type i = e.what >> 2;
+            if ((e.what & 3) == undo_reused) {
+                pool.destroy(i);
+                this->next_generation(i);
+                live_bits.reset(i);
+            } else if ((e.what & 3) == undo_retired) {
+                this->prev_generation(i);
+            }
+            pool.next(i) = e.link;
+        }
+        for (size_type i = cp.size; i < pool.size(); ++i)
+          if (live_bits(i)) {
+              pool.destroy(i);
+              this->next_generation(i);
+              live_bits.reset(i);
+          }
+        pool.truncate(cp.size);
+        free_nodes = cp.free_nodes;
+        live_exact = cp.live_exact;
+        static_cast<Stats&>(*this) = cp.stats;
+        static_cast<_free_bits<Reuse::bitmap>&>(*this) = cp.free_bits;
+        undo_below = cp.undo_below;
+        --open_checkpoints;
+    }
+
+  /*
+    keep the changes made since cp was taken, and close it. the log keeps
+    only what the enclosing checkpoint can undo, the changes to the nodes
+    older than it: the entries of the other nodes are dropped, and those
+    of them that were popped are freed (all of them, at the outermost).
+  */
+    void commit(const checkpoint_type& cp) {
+        closing(cp);
+        size_type kept = cp.log_size;
+        for (size_type k = cp.log_size; k < undo_log.size(); ++k) {
+            const undo_entry e = undo_log[k];
+            const size_type i = e.what >> 2;
+            if (i < cp.undo_below)
+              undo_log[kept++] = e;
+            else if ((e.what & 3) == undo_retired) {
+                // retire already moved it to the next generation
+                pool.destroy(i);
+                live_bits.reset(i);
+                released(i, bitmap_reuse{});
+                const stack_type x = handle_at(i);
+                give_free(x, x, 1, bitmap_reuse{});
+            }
+        }
+        undo_log.erase(undo_log.begin() + kept, undo_log.end());
+        undo_below = cp.undo_below;
+        --open_checkpoints;
+    }
+
+  /*
+    save writes a binary image of the pool: a header (with the byte order
+    and the sizes of T and N, so that a wrong image is refused by load),
+    the roots given by the user, all the links and all the values, each
+    block with a few large writes. values are written as raw bytes, so T
+    must be trivially copyable. with compress_links every link is stored
+    as a varint of its distance from the address below its node, which
+    takes a single byte for nodes pushed one after the other.
+    load replaces the content of the pool with the image and returns the
+    saved roots, so that the stacks can be found again.
+  */
+    void save(std::ostream& os, const std::vector<stack_type>& roots, bool compress_links = false) const {
+        static_assert(std::is_trivially_copyable<T>::value, "values are saved as raw bytes");
+        static_assert(!handles::generational, "the generations of the nodes are not saved");
+        image_header h{};
+        std::memcpy(h.magic, image_magic(), sizeof h.magic);
+        h.version = image_version;
+        h.byte_order = image_byte_order;
+        h.flags = compress_links ? compressed_links : 0;
+        h.value_size = sizeof(T);
+        h.index_size = sizeof(N);
+        h.size = pool.size();
+        h.free_nodes = saved_link(pool.size(), bitmap_reuse{});
+        h.n_roots = roots.size();
+        write_bytes(os, &h, sizeof h);
+        write_bytes(os, roots.data(), roots.size() * sizeof(N));
+
+        if (compress_links) {
+            std::vector<unsigned char> bytes;
+            bytes.reserve(pool.size() + 16);
+            for (size_type i = 0; i < pool.size(); ++i)
+              put_varint(bytes, zigzag(saved_link(i, bitmap_reuse{}) - i));
+            const std::uint64_t n_bytes = bytes.size();
+            write_bytes(os, &n_bytes, sizeof n_bytes);
+            write_bytes(os, bytes.data(), bytes.size());
+        } else {
+            write_blocks(os, [this](size_type i) { return saved_link(i, bitmap_reuse{}); });
+        }
+        write_blocks(os, [this](size_type i) { return pool.value(i); });
+    }
+
+    std::vector<stack_type> load(std::istream& is) {
+        static_assert(std::is_trivially_copyable<T>::value, "values are loaded as raw bytes");
+        static_assert(!handles::generational, "the generations of the nodes are not saved");
+        no_checkpoint("load");
+        image_header h;
+        read_bytes(is, &h, sizeof h);
+        if (std::memcmp(h.magic, image_magic(), sizeof h.magic) != 0)
+          throw std::runtime_error{"stack_pool: not a pool image"};
+        if (h.byte_order != image_byte_order)
+          throw std::runtime_error{"stack_pool: image saved with a different byte order"};
+        if (h.version != image_version || h.value_size != sizeof(T) || h.index_size != sizeof(N))
+          throw std::runtime_error{"stack_pool: incompatible pool image"};
+
+        if (h.size > handles::max_index || h.size > std::numeric_limits<stack_type>::max())
+          throw std::runtime_error{"stack_pool: corrupted pool image"};
+
+        const std::vector<stack_type> roots = read_vector<stack_type>(is, h.n_roots);
+        for (auto x : roots)
+          if (size_type(x) > h.size)
+            throw std::runtime_error{"stack_pool: corrupted pool image"};
+
+        std::vector<stack_type> links;
+        if (h.flags & compressed_links) {
+            std::uint64_t n_bytes;
+            read_bytes(is, &n_bytes, sizeof n_bytes);
+            // a link takes from 1 to 10 bytes
+            if (n_bytes < h.size || (n_bytes - h.size) / 9 > h.size)
+              throw std::runtime_error{"stack_pool: corrupted pool image"};
+            const std::vector<unsigned char> bytes = read_vector<unsigned char>(is, n_bytes);
+            const unsigned char* p = bytes.data();
+            const unsigned char* last = p + bytes.size();
+            links.resize(h.size);
+            for (size_type i = 0; i < links.size(); ++i)
+              links[i] = stack_type(unzigzag(get_varint(p, last)) + i);
+        } else {
+            links = read_vector<stack_type>(is, h.size);
+        }
+        for (auto x : links)
+          if (size_type(x) > links.size() || h.free_nodes > links.size())
+            throw std::runtime_error{"stack_pool: corrupted pool image"};
+
+        _live_bitmap bits;
+        bits.grow(h.size);
+        bits.set(0, h.size);
+        size_type n_free = 0;
+        for (auto x = stack_type(h.free_nodes); !empty(x); x = links[x - 1], ++n_free) {
+            if (n_free == h.size)
+              throw std::runtime_error{"stack_pool: corrupted pool image"};
+            bits.reset(x - 1);
+        }
+
+        storage_type loaded{get_allocator()};
+        loaded.reserve(h.size, _all_live{});
+        std::vector<T> values(std::min(h.size, std::uint64_t(image_block)));
+        for (size_type i = 0; i < h.size; i += values.size()) {
+            const size_type n = std::min(values.size(), size_type(h.size - i));
+            read_bytes(is, values.data(), n * sizeof(T));
+            for (size_type j = 0; j < n; ++j)
+              loaded.emplace_back(links[i + j], values[j]);
+        }
+        destroy_values();
+        pool.move_assign(std::move(loaded), []() { return _all_live{}; });
+        free_nodes = stack_type(h.free_nodes);
+        reset_free(n_free, bitmap_reuse{});
+        live_bits = std::move(bits);
+        live_exact = true;
+        Stats::reset(pool.size() - n_free, n_free);
+        return roots;
+    }
+
     private:
 
-        template <typename D>
-        stack_type _push(D&& val, stack_type head) {
-            if(!empty(free_nodes)) { 
-                stack_type tmp = free_nodes;
-                free_nodes = next(free_nodes);
-                value(tmp) = std::forward<D>(val);
-                next(tmp) = head;
-                return tmp;
+        struct image_header {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t byte_order;
+            std::uint32_t flags;
+            std::uint32_t value_size;
+            std::uint32_t index_size;
+            std::uint32_t unused;
+            std::uint64_t size;
+            std::uint64_t free_nodes;
+            std::uint64_t n_roots;
+        };
+
+        static const char* image_magic() noexcept { return "stkimage"; }
+        static constexpr std::uint32_t image_version = 1;
+        static constexpr std::uint32_t image_byte_order = 0x01020304;
+        static constexpr std::uint32_t compressed_links = 1;
+        static constexpr size_type image_block = 1 << 14; // values written or read at once
+
+        static void write_bytes(std::ostream& os, const void* p, size_type n) {
+            if (!os.write(static_cast<const char*>(p), n))
+              throw std::runtime_error{"stack_pool: cannot write the pool image"};
+        }
+
+        static void read_bytes(std::istream& is, void* p, size_type n) {
+            if (!is.read(static_cast<char*>(p), n))
+              throw std::runtime_error{"stack_pool: truncated pool image"};
+        }
+
+        /*
+          read n items, a block at a time: the memory grows only with what
+          the stream really holds, so that a corrupted count ends with a
+          truncated image instead of a huge allocation.
+        */
+        template <typename U>
+        static std::vector<U> read_vector(std::istream& is, std::uint64_t n) {
+            std::vector<U> v;
+            while (v.size() < n) {
+                const size_type k = size_type(std::min(n - v.size(), std::uint64_t(image_block)));
+                v.resize(v.size() + k);
+                read_bytes(is, v.data() + v.size() - k, k * sizeof(U));
+            }
+            return v;
+        }
+
+        // gather get(0), get(1), ... in blocks and write each block at once
+        template <typename F>
+        void write_blocks(std::ostream& os, F get) const {
+            using item = typename std::decay<decltype(get(0))>::type;
+            std::vector<item> buffer;
+            buffer.reserve(std::min(pool.size(), size_type(image_block)));
+            for (size_type i = 0; i < pool.size(); i += image_block) {
+                buffer.clear();
+                for (size_type j = i; j < std::min(pool.size(), i + image_block); ++j)
+                  buffer.push_back(get(j));
+                write_bytes(os, buffer.data(), buffer.size() * sizeof(item));
+            }
+        }
+
+        static std::uint64_t zigzag(std::uint64_t d) noexcept {
+            return (d << 1) ^ (0 - (d >> 63));
+        }
+        static std::uint64_t unzigzag(std::uint64_t z) noexcept {
+            return (z >> 1) ^ (0 - (z & 1));
+        }
+
+        static void put_varint(std::vector<unsigned char>& bytes, std::uint64_t v) {
+            for (; v >= 0x80; v >>= 7)
+              bytes.push_back(static_cast<unsigned char>(v | 0x80));
+            bytes.push_back(static_cast<unsigned char>(v));
+        }
+
+        static std::uint64_t get_varint(const unsigned char*& p, const unsigned char* last) {
+            std::uint64_t v = 0;
+            for (unsigned shift = 0; p != last && shift < 64; shift += 7) {
+                const unsigned char b = *p++;
+                v |= std::uint64_t(b & 0x7f) << shift;
+                if (!(b & 0x80))
+                  return v;
+            }
+            throw std::runtime_error{"stack_pool: corrupted pool image"};
+        }
+
+        static constexpr bool checked = handles::generational && STACK_POOL_CHECK_HANDLES;
+
+        // position in the storage of the node with address x
+        static size_type pos(stack_type x) noexcept { return handles::index(x) - 1; }
+
+        // the link of node x, whatever its generation: for free nodes
+        stack_type& link(stack_type x) noexcept { return pool.next(pos(x)); }
+        const stack_type& link(stack_type x) const noexcept { return pool.next(pos(x)); }
+
+        [[noreturn]] static void stale() { throw stale_handle{"stack_pool: stale handle"}; }
+
+        void check(stack_type x) const noexcept(!checked) {
+            if (checked && handles::generation(x) != this->generation(pos(x)))
+              stale();
+        }
+
+        // the kinds of undo_entry
+        static constexpr size_type undo_link = 0;  // the link was written
+        static constexpr size_type undo_reused = 1;  // a free node got a value
+        static constexpr size_type undo_retired = 2;  // popped: the value is kept until commit
+
+        void undo_room() {
+            if (undo_log.size() == undo_log.capacity())
+              undo_log.reserve(2 * undo_log.size() + 64);
+        }
+
+        // the link of node x is going to be written
+        void log_link(stack_type x) noexcept {
+            if (pos(x) < undo_below) {
+                undo_room();
+                undo_log.push_back({pos(x) << 2 | undo_link, link(x)});
+            }
+        }
+
+        /*
+          node x, older than the checkpoint, is popped: it keeps its value
+          for a rollback, but its handles are stale from now on.
+        */
+        void retire(stack_type x) noexcept {
+            undo_room();
+            undo_log.push_back({pos(x) << 2 | undo_retired, link(x)});
+            this->next_generation(pos(x));
+        }
+
+        void closing(const checkpoint_type& cp) const {
+            if (cp.depth != open_checkpoints)
+              throw std::logic_error{"stack_pool: checkpoints must be closed in the reverse order of opening"};
+        }
+
+        void no_checkpoint(const char* what) const {
+            if (open_checkpoints != 0)
+              throw std::logic_error{std::string{"stack_pool: "} + what + " while a checkpoint is open"};
+        }
+
+        // destroy the value of node x, which is being freed
+        void release(stack_type x) noexcept {
+            pool.destroy(pos(x));
+            this->next_generation(pos(x));
+            live_bits.reset(pos(x));
+            released(pos(x), bitmap_reuse{});
+        }
+
+        /*
+          the free nodes, linked in free_nodes (lifo_reuse) or found in the
+          bitmap of the live nodes, picked by the Reuse policy.
+        */
+        using bitmap_reuse = std::integral_constant<bool, Reuse::bitmap>;
+
+        bool has_free(std::false_type) const noexcept { return !empty(free_nodes); }
+        bool has_free(std::true_type) const noexcept { return this->n_free != 0; }
+
+        // the position of the free node to take for a push on head
+        size_type free_pos(stack_type, std::false_type) const noexcept { return pos(free_nodes); }
+        size_type free_pos(stack_type head, std::true_type) noexcept {
+            return Reuse::pick(live_bits, pool.size(), this->free_hint, empty(head) ? Reuse::no_head : pos(head));
+        }
+
+        // the free node at position i now holds a value
+        void taken(size_type i, std::false_type) noexcept { free_nodes = pool.next(i); }
+        void taken(size_type, std::true_type) noexcept { --this->n_free; }
+
+        // the node at position i was released
+        void released(size_type, std::false_type) noexcept {}
+        void released(size_type i, std::true_type) noexcept {
+            this->free_hint = std::min(this->free_hint, i / _live_bitmap::word_bits);
+        }
+
+        // the n nodes from first to last (linked) were released
+        void give_free(stack_type first, stack_type last, size_type, std::false_type) noexcept {
+            link(last) = free_nodes;
+            free_nodes = first;
+        }
+        void give_free(stack_type, stack_type, size_type n, std::true_type) noexcept { this->n_free += n; }
+
+        // the free nodes were rearranged: n_free of them, linked in free_nodes
+        void reset_free(size_type, std::false_type) noexcept {}
+        void reset_free(size_type n_free, std::true_type) noexcept {
+            free_nodes = end();
+            this->n_free = n_free;
+            this->free_hint = 0;
+        }
+
+        // forget the free nodes past the first n, returning how many are left
+        size_type drop_free(size_type n, std::false_type) noexcept {
+            stack_type* link = &free_nodes;
+            size_type n_free = 0;
+            for (auto x = free_nodes; !empty(x); x = this->link(x))
+              if (handles::index(x) <= n) {
+                *link = x;
+                link = &this->link(x);
+                ++n_free;
+              }
+            *link = end();
+            return n_free;
+        }
+        size_type drop_free(size_type n, std::true_type) noexcept {
+            this->n_free -= pool.size() - n;
+            this->free_hint = 0;
+            return this->n_free;
+        }
+
+        /*
+          the link saved for node i, and the head of the free nodes for
+          i = pool.size(): with a bitmap policy, the free nodes are saved
+          linked by increasing address.
+        */
+        stack_type saved_link(size_type i, std::false_type) const noexcept {
+            return i == pool.size() ? free_nodes : pool.next(i);
+        }
+        stack_type saved_link(size_type i, std::true_type) const noexcept {
+            if (i < pool.size() && live_bits(i))
+              return pool.next(i);
+            for (size_type j = i == pool.size() ? 0 : i + 1; j < pool.size(); ++j)
+              if (!live_bits(j))
+                return stack_type(j + 1);
+            return end();
+        }
+
+        // the fresh nodes get the next addresses, which must fit in a handle
+        void make_room(size_type n) {
+            if (handles::generational && pool.size() + n > handles::max_index)
+              throw std::length_error{"stack_pool: too many nodes for the handles"};
+            this->grow_generations(pool.size() + n);
+            live_bits.grow(pool.size() + n);
+        }
+
+        void reserve_nodes(size_type n) {
+            pool.reserve(n, _all_live{});
+            this->grow_generations(n);
+            live_bits.grow(n);
+        }
+
+        // the nodes that hold a value: all but the free ones
+        _live_bitmap live() const {
+            if (live_exact)
+              return live_bits;
+            _live_bitmap l;
+            l.grow(pool.size());
+            l.set(0, pool.size());
+            for (auto x = free_nodes; !empty(x); x = link(x))
+              l.reset(pos(x));
+            return l;
+        }
+
+        /*
+          the nodes in some stack: the live ones but those popped since a
+          checkpoint, which keep their value until it is committed. when
+          no checkpoint has nodes below it, the bitmap is exact.
+        */
+        bool scan_live_bits() const noexcept { return live_exact && undo_below == 0; }
+        _live_bitmap in_stacks() const {
+            _live_bitmap l = live();
+            for (const auto& e : undo_log)
+              if ((e.what & 3) == undo_retired)
+                l.reset(e.what >> 2);
+            return l;
+        }
+
+        void destroy_values() noexcept {
+            if (!std::is_trivially_destructible<T>::value)
+              pool.clear(live());
+        }
+
+        template <typename... Args>
+        stack_type _push(stack_type head, Args&&... args) {
+            if(has_free(bitmap_reuse{})) { 
+                return _reuse(head, std::forward<Args>(args)...);
             }
             else  {
-                pool.push_back({std::forward<D>(val),head});
-                return pool.size();
+                const size_type before = capacity();
+                make_room(1);
+                pool.emplace_back(head, std::forward<Args>(args)...);
+                live_bits.set(pool.size() - 1);
+                grown(before);
+                Stats::pushed(1, 0);
+                return handle_at(pool.size() - 1);
             }
         }
 
+        template <typename D>
+        stack_descriptor _push_descriptor(D&& val, stack_descriptor d) {
+            d.head = _push(d.head, std::forward<D>(val));
+            if(d.size++ == 0)
+              d.tail = d.head;
+            return d;
+        }
+
+        /*
+          take the free node chosen by the Reuse policy and put it on top of
+          the stack. the value is built first: if that throws, the node is
+          still free.
+        */
+        template <typename... Args>
+        stack_type _reuse(stack_type head, Args&&... args) {
+            const size_type i = free_pos(head, bitmap_reuse{});
+            if (i < undo_below)
+              undo_room();
+            pool.construct(i, std::forward<Args>(args)...);
+            if (i < undo_below)
+              undo_log.push_back({i << 2 | undo_reused, pool.next(i)});
+            live_bits.set(i);
+            taken(i, bitmap_reuse{});
+            pool.next(i) = head;
+            Stats::pushed(0, 1);
+            return handle_at(i);
+        }
+
+        template <typename Self, typename F>
+        static void _sweep(Self& self, const _live_bitmap& live, F& f) {
+            const size_type n = self.pool.size();
+            for (size_type base = 0; base < n; base += _live_bitmap::word_bits)
+              for (std::uint64_t bits = live.word(base / _live_bitmap::word_bits); bits != 0; bits &= bits - 1)
+                f(self.pool.value(base + __builtin_ctzll(bits)));
+        }
+
+        // whether reduce_live can split the values in lanes
+        template <typename R>
+        using _lanes = std::integral_constant<bool, std::is_same<R, T>::value && std::is_arithmetic<T>::value>;
+
+        template <typename R, typename Op>
+        R _reduce_live(const _live_bitmap& live, R acc, Op& op, std::false_type) const {
+            const size_type n = pool.size();
+            for (size_type base = 0; base < n; base += _live_bitmap::word_bits)
+              for (std::uint64_t bits = live.word(base / _live_bitmap::word_bits); bits != 0; bits &= bits - 1)
+                acc = op(std::move(acc), pool.value(base + __builtin_ctzll(bits)));
+            return acc;
+        }
+
+        template <typename Op>
+        T _reduce_live(const _live_bitmap& live, T acc, Op& op, std::true_type) const {
+            constexpr size_type lanes = 8;
+            const size_type n = pool.size();
+            for (size_type base = 0; base < n; base += _live_bitmap::word_bits) {
+                std::uint64_t bits = live.word(base / _live_bitmap::word_bits);
+                if (bits == ~std::uint64_t(0)) {
+                    T lane[lanes];
+                    for (size_type k = 0; k < lanes; ++k)
+                      lane[k] = pool.value(base + k);
+                    for (size_type j = lanes; j < _live_bitmap::word_bits; j += lanes)
+                      for (size_type k = 0; k < lanes; ++k)
+                        lane[k] = op(lane[k], pool.value(base + j + k));
+                    for (size_type k = 0; k < lanes; ++k)
+                      acc = op(acc, lane[k]);
+                } else {
+                    for (; bits != 0; bits &= bits - 1)
+                      acc = op(acc, pool.value(base + __builtin_ctzll(bits)));
+                }
+            }
+            return acc;
+        }
+
+        template <typename Pred>
+        size_type _count_live(const _live_bitmap& live, Pred& pred) const {
+            const size_type n = pool.size();
+            size_type count = 0;
+            size_type base = 0;
+            if (std::is_arithmetic<T>::value)
+              for (; base + _live_bitmap::word_bits <= n; base += _live_bitmap::word_bits) {
+                  const std::uint64_t bits = live.word(base / _live_bitmap::word_bits);
+                  std::uint64_t matches = 0;
+                  for (size_type j = 0; j < _live_bitmap::word_bits; ++j)
+                    matches |= std::uint64_t(bool(pred(pool.value(base + j)))) << j;
+                  count += __builtin_popcountll(matches & bits);
+              }
+            for (; base < n; base += _live_bitmap::word_bits)
+              for (std::uint64_t bits = live.word(base / _live_bitmap::word_bits); bits != 0; bits &= bits - 1)
+                count += bool(pred(pool.value(base + __builtin_ctzll(bits))));
+            return count;
+        }
+
+        // merge the sorted stacks a and b, taking from a on ties
+        template <typename Compare>
+        stack_type _merged(stack_type a, stack_type b, Compare& cmp) {
+            if(empty(a))
+              return b;
+            stack_type head = end();
+            stack_type* tail = &head;  // where the next node taken goes
+            stack_type last = end();  // the node *tail belongs to
+            while(!empty(a) && !empty(b)) {
+                stack_type& first = cmp(value(b), value(a)) ? b : a;
+                log_link(last);
+                *tail = first;
+                last = first;
+                tail = &next(first);
+                first = *tail;
+            }
+            log_link(last);
+            *tail = empty(a) ? b : a;
+            return head;
+        }
+
+        // the handle that the node at position i will have once compact is done
+        stack_type compacted_handle(size_type i) const noexcept { return handles::make(i + 1, this->generation_after(i)); }
+
+        // the handle of the node at position i, in its current generation
+        stack_type handle_at(size_type i) const noexcept { return handles::make(i + 1, this->generation(i)); }
+
+        /*
+          append links every node from position from on to the address of
+          the one before it, with no generation: the addresses cut by a
+          rollback are in a later one, so the links must carry it.
+        */
+        void tag_appended(size_type from) noexcept {
+            if (handles::generational)
+              for (size_type i = from + 1; i < pool.size(); ++i)
+                pool.next(i) = handle_at(i - 1);
+        }
+
+        // tell the Stats policy if the storage had to grow
+        void grown(size_type before) noexcept {
+            if (capacity() != before)
+              Stats::reallocated();
+        }
+
+        template <typename I>
+        stack_type _push_range(I first, I last, stack_type head, std::forward_iterator_tag) {
+            for (; first != last && has_free(bitmap_reuse{}); ++first)
+                head = _reuse(head, *first);
+            if (first != last) {
+                const size_type size = pool.size();
+                const size_type before = capacity();
+                make_room(std::distance(first, last));
+                pool.append(first, last, head);
+                live_bits.set(size, pool.size());
+                grown(before);
+                Stats::pushed(pool.size() - size, 0);
+                tag_appended(size);
+                head = handle_at(pool.size() - 1);
+            }
+            return head;
+        }
+
+        // single pass iterators cannot be measured in advance
+        template <typename I>
+        stack_type _push_range(I first, I last, stack_type head, std::input_iterator_tag) {
+            for (; first != last; ++first)
+                head = _push(head, *first);
+            return head;
+        }
+
 };
@@ -1,7 +1,16 @@
 #include "catch.hpp"
 
 #include "stack_pool.hpp"
+#include "allocators.hpp"
 #include <algorithm> // max_element, min_element
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
 
 SCENARIO("getting confident with the addresses"){
   stack_pool<int, std::size_t> pool{16};
@@ -169,3 +178,1107 @@ SCENARIO("using iterators"){
   }
 
 }
+
+SCENARIO("storing values and links in separate arrays"){
+  GIVEN("a pool with the structure of arrays layout"){
+    stack_pool<char, std::size_t, soa_layout> pool{};
+    auto l1 = pool.new_stack();
+    l1 = pool.push('a', l1);
+    l1 = pool.push('b', l1);
+    l1 = pool.push('c', l1);
+
+    auto l2 = pool.new_stack();
+    l2 = pool.push('x', l2);
+
+    THEN("addresses are the same as with the default layout"){
+      REQUIRE(l1 == std::size_t(3));
+      REQUIRE(l2 == std::size_t(4));
+      REQUIRE(pool.value(pool.next(l1)) == 'b');
+    }
+
+    WHEN("we pop and push again"){
+      l1 = pool.pop(l1);
+      l2 = pool.push('y', l2);
+      THEN("the freed node is reused"){
+        REQUIRE(l2 == std::size_t(3));
+        REQUIRE(pool.value(l2) == 'y');
+        REQUIRE(pool.value(pool.next(l2)) == 'x');
+      }
+    }
+
+    THEN("iterators walk the stack as usual"){
+      auto m = std::max_element(pool.begin(l1), pool.end(l1));
+      REQUIRE(*m == 'c');
+      REQUIRE(std::distance(pool.cbegin(l1), pool.cend(l1)) == 3);
+    }
+
+    WHEN("we free the whole stack"){
+      l1 = pool.free_stack(l1);
+      REQUIRE(pool.empty(l1));
+      l2 = pool.push('z', l2);
+      REQUIRE(l2 <= std::size_t(3));
+    }
+  }
+}
+
+SCENARIO("pushing and popping many values at once"){
+  GIVEN("a pool and a range of values"){
+    stack_pool<int, std::size_t> pool{};
+    const std::vector<int> v{1, 2, 3, 4, 5};
+
+    WHEN("we push the whole range on a new stack"){
+      auto l = pool.push_range(v.begin(), v.end(), pool.new_stack());
+
+      THEN("the last value is on top, as pushing one value at a time"){
+        REQUIRE(l == std::size_t(5));
+        std::vector<int> content{pool.begin(l), pool.end(l)};
+        REQUIRE(content == std::vector<int>{5, 4, 3, 2, 1});
+      }
+
+      WHEN("we pop three nodes at once"){
+        l = pool.pop_n(l, 3);
+        REQUIRE(pool.value(l) == 2);
+
+        THEN("the freed nodes are reused before appending new ones"){
+          auto l2 = pool.push_n(4, 7, pool.new_stack());
+          REQUIRE(pool.capacity() >= 6);
+          std::vector<int> content{pool.begin(l2), pool.end(l2)};
+          REQUIRE(content == std::vector<int>{7, 7, 7, 7});
+          REQUIRE(l2 == std::size_t(6));
+          REQUIRE(pool.next(pool.next(pool.next(l2))) == std::size_t(5));
+        }
+      }
+
+      THEN("popping more nodes than the stack has empties it"){
+        l = pool.pop_n(l, 42);
+        REQUIRE(pool.empty(l));
+        auto l2 = pool.push_n(5, 0, pool.new_stack());
+        REQUIRE(l2 <= std::size_t(5));
+      }
+    }
+  }
+
+  GIVEN("a pool with the structure of arrays layout"){
+    stack_pool<int, uint16_t, soa_layout> pool{};
+    const int a[] = {3, 1, 4, 1, 5};
+    auto l1 = pool.push(9, pool.new_stack());
+    l1 = pool.push_range(std::begin(a), std::end(a), l1);
+    std::vector<int> content{pool.begin(l1), pool.end(l1)};
+    REQUIRE(content == std::vector<int>{5, 1, 4, 1, 3, 9});
+    REQUIRE(pool.next(l1) == uint16_t(5));
+  }
+}
+
+SCENARIO("stacks tracked by descriptors"){
+  GIVEN("two stacks built through descriptors"){
+    stack_pool<int, std::size_t> pool{};
+    auto a = pool.new_descriptor();
+    auto b = pool.new_descriptor();
+    REQUIRE(pool.empty(a));
+    REQUIRE(pool.size(a) == 0);
+
+    a = pool.push(1, a);
+    a = pool.push(2, a);
+    b = pool.push(3, b);
+    b = pool.push(4, b);
+    b = pool.push(5, b);
+
+    THEN("head, tail and size are kept up to date"){
+      REQUIRE(pool.value(a.head) == 2);
+      REQUIRE(pool.value(a.tail) == 1);
+      REQUIRE(pool.size(a) == 2);
+      REQUIRE(pool.size(b) == 3);
+      REQUIRE(pool.describe(b.head).tail == b.tail);
+    }
+
+    WHEN("we concatenate them"){
+      auto c = pool.concat(a, b);
+      THEN("a lies on top of b"){
+        REQUIRE(pool.size(c) == 5);
+        REQUIRE(c.tail == b.tail);
+        std::vector<int> content{pool.begin(c), pool.end(c)};
+        REQUIRE(content == std::vector<int>{2, 1, 5, 4, 3});
+      }
+
+      WHEN("we free the result"){
+        c = pool.free_stack(c);
+        REQUIRE(pool.empty(c));
+        THEN("all its nodes are reused"){
+          auto l = pool.push_n(5, 0, pool.new_stack());
+          REQUIRE(l <= std::size_t(5));
+          REQUIRE(pool.capacity() >= 5);
+        }
+      }
+    }
+
+    WHEN("we pop every node"){
+      a = pool.pop(a);
+      REQUIRE(pool.size(a) == 1);
+      REQUIRE(a.head == a.tail);
+      a = pool.pop(a);
+      REQUIRE(pool.empty(a));
+      REQUIRE(a.tail == pool.end());
+      a = pool.pop(a);
+      REQUIRE(pool.size(a) == 0);
+    }
+  }
+}
+
+SCENARIO("compacting a pool after many pushes and pops"){
+  GIVEN("two stacks whose nodes are interleaved, with some free nodes"){
+    stack_pool<int, std::size_t> pool{};
+    auto l1 = pool.new_stack();
+    auto l2 = pool.new_stack();
+    auto l3 = pool.new_stack();
+    for (int i = 0; i < 4; ++i) {
+      l1 = pool.push(i, l1);
+      l2 = pool.push(10 + i, l2);
+      l3 = pool.push(20 + i, l3);
+    }
+    l3 = pool.free_stack(l3);
+    l1 = pool.pop(l1);
+
+    WHEN("we compact them"){
+      auto heads = pool.compact({l1, l2, pool.new_stack()});
+
+      THEN("each stack is contiguous and in traversal order"){
+        REQUIRE(heads[0] == std::size_t(1));
+        REQUIRE(heads[1] == std::size_t(4));
+        REQUIRE(heads[2] == pool.end());
+        REQUIRE(pool.next(heads[0]) == std::size_t(2));
+        REQUIRE(pool.next(std::size_t(3)) == pool.end());
+        std::vector<int> c1{pool.begin(heads[0]), pool.end(heads[0])};
+        std::vector<int> c2{pool.begin(heads[1]), pool.end(heads[1])};
+        REQUIRE(c1 == std::vector<int>{2, 1, 0});
+        REQUIRE(c2 == std::vector<int>{13, 12, 11, 10});
+      }
+
+      THEN("the pool keeps just the live nodes"){
+        REQUIRE(pool.capacity() == 7);
+        auto l = pool.push(42, pool.new_stack());
+        REQUIRE(l == std::size_t(8));
+      }
+    }
+  }
+
+  GIVEN("a pool whose last nodes are free"){
+    stack_pool<int, std::size_t> pool{64};
+    auto l1 = pool.push_n(3, 1, pool.new_stack());
+    auto l2 = pool.push_n(3, 2, pool.new_stack());
+    l1 = pool.pop(l1);
+    l2 = pool.free_stack(l2);
+
+    WHEN("we shrink it"){
+      pool.shrink_to_fit();
+      THEN("trailing free nodes and spare capacity are released"){
+        REQUIRE(pool.capacity() == 2);
+        REQUIRE(pool.value(l1) == 1);
+        REQUIRE(std::distance(pool.begin(l1), pool.end(l1)) == 2);
+        auto l = pool.push(5, pool.new_stack());
+        REQUIRE(l == std::size_t(3));
+      }
+    }
+  }
+}
+
+SCENARIO("saving and loading a binary image of the pool"){
+  GIVEN("a pool with two stacks and some free nodes"){
+    stack_pool<int, uint16_t> pool{};
+    auto l1 = pool.new_stack();
+    for (int i = 0; i < 100; ++i)
+      l1 = pool.push(i, l1);
+    auto l2 = pool.push_n(3, 7, pool.new_stack());
+    l1 = pool.pop_n(l1, 10);
+
+    THEN("a round trip keeps stacks and free nodes, compressed or not"){
+      for (bool compress : {false, true}) {
+        std::stringstream image;
+        pool.save(image, {l1, l2}, compress);
+
+        stack_pool<int, uint16_t> copy{};
+        auto roots = copy.load(image);
+
+        REQUIRE(roots.size() == 2);
+        REQUIRE(roots[0] == l1);
+        std::vector<int> c1{copy.begin(roots[0]), copy.end(roots[0])};
+        std::vector<int> c2{copy.begin(roots[1]), copy.end(roots[1])};
+        REQUIRE(c1 == std::vector<int>{pool.begin(l1), pool.end(l1)});
+        REQUIRE(c2 == std::vector<int>{7, 7, 7});
+        REQUIRE(copy.push(0, copy.new_stack()) == uint16_t(100));
+      }
+    }
+
+    THEN("compressed links take less space"){
+      std::stringstream raw, compressed;
+      pool.save(raw, {l1});
+      pool.save(compressed, {l1}, true);
+      REQUIRE(compressed.str().size() < raw.str().size());
+    }
+
+    THEN("a corrupted size is refused before anything is allocated"){
+      // the header: magic, six 32 bit fields, then size, free_nodes and n_roots
+      const auto corrupt = [&](bool compress, std::size_t offset, std::uint64_t v) {
+        std::stringstream image;
+        pool.save(image, {l1, l2}, compress);
+        std::string bytes = image.str();
+        std::memcpy(&bytes[offset], &v, sizeof v);
+        std::stringstream broken{bytes};
+        stack_pool<int, uint16_t> copy{};
+        REQUIRE_THROWS_WITH(copy.load(broken), Catch::Contains("pool image"));
+      };
+      for (bool compress : {false, true}) {
+        corrupt(compress, 32, std::uint64_t(1) << 62);  // size
+        corrupt(compress, 32, 70000);                    // size, past uint16_t
+        corrupt(compress, 48, std::uint64_t(1) << 62);  // n_roots
+      }
+      corrupt(false, 56, 500);                  // the roots, past the size
+      corrupt(true, 60, std::uint64_t(1) << 62);  // the bytes of the compressed links
+    }
+
+    THEN("an image of another pool type is refused"){
+      std::stringstream image;
+      pool.save(image, {l1});
+      stack_pool<double, uint16_t> other{};
+      REQUIRE_THROWS_AS(other.load(image), std::runtime_error);
+    }
+  }
+}
+
+SCENARIO("storing the nodes in fixed size chunks"){
+  GIVEN("a pool with chunks of four nodes"){
+    stack_pool<std::string, std::size_t, segmented_layout<2>> pool{};
+    auto l = pool.push("first", pool.new_stack());
+    const std::string& first = pool.value(l);
+
+    for (int i = 0; i < 20; ++i)
+      l = pool.push(std::to_string(i), l);
+
+    THEN("growing the pool does not move the nodes"){
+      REQUIRE(&first == &pool.value(std::size_t(1)));
+      REQUIRE(first == "first");
+      REQUIRE(pool.capacity() == 24);
+      REQUIRE(std::distance(pool.begin(l), pool.end(l)) == 21);
+      REQUIRE(pool.value(l) == "19");
+    }
+
+    WHEN("we free most nodes and shrink the pool"){
+      l = pool.pop_n(l, 18);
+      pool.shrink_to_fit();
+      THEN("the chunks that are not needed anymore are released"){
+        REQUIRE(pool.capacity() == 4);
+        std::vector<std::string> content{pool.begin(l), pool.end(l)};
+        REQUIRE(content == std::vector<std::string>{"1", "0", "first"});
+      }
+    }
+
+    WHEN("we compact the pool"){
+      auto heads = pool.compact({l});
+      REQUIRE(pool.capacity() == 24);
+      REQUIRE(pool.value(heads[0]) == "19");
+      REQUIRE(pool.next(heads[0]) == std::size_t(2));
+    }
+  }
+}
+
+SCENARIO("choosing the allocator of the pool"){
+  GIVEN("a pool allocating cache aligned memory"){
+    stack_pool<int, std::size_t, soa_layout, cache_aligned_allocator<int>> pool{};
+    auto l = pool.push_n(100, 3, pool.new_stack());
+    THEN("both arrays start on a cache line"){
+      REQUIRE(reinterpret_cast<std::uintptr_t>(&pool.value(1)) % 64 == 0);
+      REQUIRE(reinterpret_cast<std::uintptr_t>(&pool.next(1)) % 64 == 0);
+      REQUIRE(std::distance(pool.begin(l), pool.end(l)) == 100);
+    }
+  }
+
+  GIVEN("a large pool allocating huge pages"){
+    const std::size_t n = 1 << 18;
+    stack_pool<long, std::size_t, aos_layout, huge_page_allocator<long>> pool{n};
+    auto l = pool.push_n(n, 1, pool.new_stack());
+    THEN("the nodes start on a 2 MiB boundary"){
+      REQUIRE(reinterpret_cast<std::uintptr_t>(&pool.value(1)) % (1 << 21) == 0);
+      REQUIRE(*std::max_element(pool.begin(l), pool.end(l)) == 1);
+    }
+
+    WHEN("the pool is compacted"){
+      auto heads = pool.compact({l});
+      THEN("the new storage uses the same allocator"){
+        REQUIRE(reinterpret_cast<std::uintptr_t>(&pool.value(heads[0])) % (1 << 21) == 0);
+      }
+    }
+  }
+
+  GIVEN("a segmented pool with a custom allocator"){
+    stack_pool<std::string, uint16_t, segmented_layout<3>, cache_aligned_allocator<std::string>> pool{};
+    auto l = pool.new_stack();
+    for (int i = 0; i < 20; ++i)
+      l = pool.push(std::to_string(i), l);
+    auto copy = pool;
+    REQUIRE(copy.value(l) == "19");
+    REQUIRE(reinterpret_cast<std::uintptr_t>(&copy.value(1)) % 64 == 0);
+  }
+}
+
+SCENARIO("iterating with prefetching iterators"){
+  GIVEN("a stack"){
+    stack_pool<int, uint16_t, soa_layout> pool{};
+    auto l = pool.new_stack();
+    for (int i = 0; i < 10; ++i)
+      l = pool.push(i, l);
+
+    THEN("the same values are visited, whatever the distance"){
+      const std::vector<int> expected{pool.begin(l), pool.end(l)};
+      REQUIRE(std::vector<int>(pool.prefetch_begin(l), pool.prefetch_end(l)) == expected);
+      REQUIRE(std::vector<int>(pool.prefetch_begin<1>(l), pool.prefetch_end<1>(l)) == expected);
+      REQUIRE(std::vector<int>(pool.prefetch_begin<16>(l), pool.prefetch_end<16>(l)) == expected);
+    }
+
+    THEN("they work with the algorithms of the standard library"){
+      const auto& cpool = pool;
+      REQUIRE(*std::max_element(cpool.prefetch_begin<8>(l), cpool.prefetch_end<8>(l)) == 9);
+      auto it = pool.prefetch_begin(l);
+      *it = 42;
+      REQUIRE(pool.value(l) == 42);
+    }
+  }
+}
+
+SCENARIO("counting what happens in a pool"){
+  static_assert(sizeof(stack_pool<int>) == sizeof(stack_pool<int, std::size_t, aos_layout, std::allocator<int>, no_stats>), "");
+  // the storage, the free list, the bitmap of the live nodes with its flag, the undo log with its two counters
+  static_assert(sizeof(stack_pool<int>) == sizeof(aos_layout::storage<int, std::size_t, std::allocator<int>>) + 4 * sizeof(std::size_t) + 2 * sizeof(std::vector<std::uint64_t>), "no_stats takes no room");
+
+  GIVEN("a pool keeping statistics"){
+    stack_pool<int, std::size_t, aos_layout, std::allocator<int>, count_stats> pool{};
+    auto l1 = pool.new_stack();
+    auto l2 = pool.new_stack();
+    for (int i = 0; i < 10; ++i)
+      l1 = pool.push(i, l1);
+    const std::vector<int> v{1, 2, 3};
+    l2 = pool.push_range(v.begin(), v.end(), l2);
+
+    THEN("pushes and live nodes are counted"){
+      const auto s = pool.stats();
+      REQUIRE(s.pushes == 13);
+      REQUIRE(s.live_nodes == 13);
+      REQUIRE(s.free_nodes == 0);
+      REQUIRE(s.high_water == 13);
+      REQUIRE(s.reallocations > 0);
+      REQUIRE(s.capacity == pool.capacity());
+      REQUIRE(s.reuse_ratio() == 0);
+    }
+
+    WHEN("nodes are given back and reused"){
+      l1 = pool.pop(l1);
+      l1 = pool.pop_n(l1, 4);
+      l2 = pool.free_stack(l2);
+      l2 = pool.push_n(2, 7, l2);
+      const auto s = pool.stats();
+
+      THEN("the free nodes and the reuse ratio follow"){
+        REQUIRE(s.pops == 8);
+        REQUIRE(s.live_nodes == 7);
+        REQUIRE(s.free_nodes == 6);
+        REQUIRE(s.high_water == 13);
+        REQUIRE(s.reused == 2);
+        REQUIRE(s.reuse_ratio() == Approx(2.0 / 15));
+      }
+
+      THEN("the stacks can be sampled"){
+        const auto sampled = pool.stats({l1, l2, pool.new_stack()});
+        REQUIRE(sampled.stacks == 3);
+        REQUIRE(sampled.max_stack_length == 5);
+        REQUIRE(sampled.mean_stack_length == Approx(7.0 / 3));
+      }
+
+      THEN("compact and shrink_to_fit keep the counters right"){
+        auto heads = pool.compact({l1, l2});
+        REQUIRE(pool.stats().live_nodes == 7);
+        REQUIRE(pool.stats().free_nodes == 0);
+        heads[1] = pool.free_stack(heads[1]);
+        pool.shrink_to_fit();
+        REQUIRE(pool.stats().live_nodes == 5);
+        REQUIRE(pool.stats().free_nodes == 0);
+      }
+    }
+
+    THEN("they can be dumped as text or JSON"){
+      std::ostringstream text;
+      text << pool.stats();
+      REQUIRE(text.str().find("pushes: 13\n") != std::string::npos);
+      const auto json = to_json(pool.stats());
+      REQUIRE(json.front() == '{');
+      REQUIRE(json.back() == '}');
+      REQUIRE(json.find("\"live_nodes\": 13") != std::string::npos);
+    }
+  }
+}
+
+// counts the objects alive and how they were made; it cannot be assigned
+struct tracked {
+  static int alive, copies, moves;
+  const int id;
+  explicit tracked(int i) : id{i} { ++alive; }
+  tracked(int a, int b) : id{a + b} { ++alive; }
+  tracked(const tracked& x) : id{x.id} { ++alive; ++copies; }
+  tracked(tracked&& x) noexcept : id{x.id} { ++alive; ++moves; }
+  ~tracked() { --alive; }
+  tracked& operator=(const tracked&) = delete;
+  static void reset() { alive = copies = moves = 0; }
+};
+int tracked::alive = 0;
+int tracked::copies = 0;
+int tracked::moves = 0;
+
+TEMPLATE_TEST_CASE("values live only in the nodes of a stack", "", aos_layout, soa_layout, segmented_layout<2>){
+  tracked::reset();
+  {
+    GIVEN("a pool of values without default constructor nor assignment"){
+      stack_pool<tracked, uint16_t, TestType> pool{};
+      auto l = pool.new_stack();
+      for (int i = 0; i < 10; ++i)
+        l = pool.emplace(l, i);
+      REQUIRE(tracked::alive == 10);
+      REQUIRE(tracked::copies == 0);
+
+      WHEN("nodes are popped"){
+        l = pool.pop(l);
+        l = pool.pop_n(l, 3);
+        THEN("their values are destroyed"){
+          REQUIRE(tracked::alive == 6);
+          REQUIRE(pool.value(l).id == 5);
+        }
+        AND_THEN("free nodes are reused constructing in place"){
+          const int moves = tracked::moves;
+          l = pool.emplace(l, 20, 22);
+          REQUIRE(pool.value(l).id == 42);
+          REQUIRE(tracked::alive == 7);
+          REQUIRE(tracked::moves == moves);
+          REQUIRE(tracked::copies == 0);
+        }
+      }
+
+      WHEN("the stack is freed"){
+        auto d = pool.describe(l);
+        auto l2 = pool.push_n(3, tracked{7}, pool.new_stack());
+        REQUIRE(tracked::alive == 13);
+        l2 = pool.free_stack(l2);
+        REQUIRE(tracked::alive == 10);
+        d = pool.free_stack(d);
+        THEN("no value is left"){
+          REQUIRE(tracked::alive == 0);
+        }
+      }
+
+      WHEN("the pool is copied or moved"){
+        l = pool.pop_n(l, 4);
+        auto copy = pool;
+        REQUIRE(tracked::alive == 12);
+        REQUIRE(std::distance(copy.begin(l), copy.end(l)) == 6);
+        auto moved = std::move(copy);
+        REQUIRE(tracked::alive == 12);
+        copy = moved;
+        REQUIRE(tracked::alive == 18);
+        REQUIRE(copy.value(l).id == 5);
+      }
+
+      WHEN("the pool is compacted or shrunk"){
+        auto l2 = pool.emplace(pool.new_stack(), 100);
+        l = pool.pop_n(l, 5);
+        auto heads = pool.compact({l});
+        REQUIRE(tracked::alive == 5);
+        l2 = pool.emplace(pool.new_stack(), 101);
+        l2 = pool.pop(l2);
+        pool.shrink_to_fit();
+        REQUIRE(tracked::alive == 5);
+        REQUIRE(pool.value(heads[0]).id == 4);
+      }
+    }
+  }
+  REQUIRE(tracked::alive == 0);
+}
+
+SCENARIO("pushing values that live in the same pool"){
+  GIVEN("a full pool of strings"){
+    stack_pool<std::string, uint16_t> pool{};
+    auto l = pool.push(std::string(40, 'a'), pool.new_stack());
+    l = pool.push(std::string(40, 'b'), l);
+    while (pool.capacity() > std::size_t(std::distance(pool.begin(l), pool.end(l))))
+      l = pool.push(std::string(40, 'b'), l);
+    auto l2 = pool.new_stack();
+    THEN("growing the pool keeps the value being pushed"){
+      l = pool.push(pool.value(l), l);
+      l2 = pool.push_n(10, pool.value(l), l2);
+      REQUIRE(pool.value(l) == std::string(40, 'b'));
+      REQUIRE(std::all_of(pool.begin(l2), pool.end(l2), [](const std::string& s) { return s == std::string(40, 'b'); }));
+    }
+  }
+}
+
+SCENARIO("generational handles"){
+  using handle = generational<std::uint32_t, 8>;
+  using traits = handle_traits<handle>;
+  GIVEN("a pool with handles of 24 bits of address and 8 of generation"){
+    stack_pool<int, handle> pool{};
+    auto l = pool.push(1, pool.new_stack());
+    l = pool.push(2, l);
+    REQUIRE(sizeof(l) == sizeof(std::uint32_t));
+    REQUIRE(pool.value(l) == 2);
+    REQUIRE(pool.value(pool.next(l)) == 1);
+
+    WHEN("a node is popped and its slot reused"){
+      const auto stale = l;
+      l = pool.pop(l);
+      auto l2 = pool.push(3, pool.new_stack());
+      THEN("the new handle has the same address and the next generation"){
+        REQUIRE(traits::index(l2) == traits::index(stale));
+        REQUIRE(traits::generation(l2) == traits::generation(stale) + 1);
+        REQUIRE(pool.value(l2) == 3);
+        REQUIRE(pool.value(l) == 1);
+      }
+#if STACK_POOL_CHECK_HANDLES
+      THEN("the old handle is detected"){
+        REQUIRE_THROWS_AS(pool.value(stale), stale_handle);
+        REQUIRE_THROWS_AS(pool.next(stale), stale_handle);
+        REQUIRE_THROWS_AS(pool.pop(stale), stale_handle);
+        REQUIRE(pool.value(l2) == 3);
+      }
+#endif
+    }
+
+    WHEN("whole stacks are freed"){
+      const auto top = l;
+      const auto bottom = pool.next(l);
+      l = pool.free_stack(l);
+      const std::vector<int> v{4, 5, 6};
+      auto d = pool.describe(pool.push_range(v.begin(), v.end(), pool.new_stack()));
+      REQUIRE(traits::generation(d.head) == 0);
+      d = pool.free_stack(d);
+      auto l2 = pool.push(7, pool.new_stack());
+      l2 = pool.push(8, l2);
+      THEN("every node freed gets a new generation"){
+        REQUIRE(traits::generation(l2) > 0);
+        REQUIRE(traits::generation(pool.next(l2)) > 0);
+        REQUIRE(traits::generation(top) == 0);
+#if STACK_POOL_CHECK_HANDLES
+        REQUIRE_THROWS_AS(pool.value(top), stale_handle);
+        REQUIRE_THROWS_AS(pool.value(bottom), stale_handle);
+#endif
+        (void)bottom;
+      }
+    }
+
+    WHEN("the pool is compacted"){
+      const auto popped = l;
+      l = pool.pop(l);
+      auto heads = pool.compact({l});
+      THEN("every address moves to its next generation"){
+        REQUIRE(traits::index(heads[0]) == traits::index(l));
+        REQUIRE(traits::generation(heads[0]) == traits::generation(l) + 1);
+        REQUIRE(pool.value(heads[0]) == 1);
+        auto l2 = pool.push(3, pool.new_stack());
+        REQUIRE(traits::index(l2) == traits::index(popped));
+        REQUIRE(traits::generation(l2) == traits::generation(popped) + 2);
+#if STACK_POOL_CHECK_HANDLES
+        REQUIRE_THROWS_AS(pool.value(l), stale_handle);
+        REQUIRE_THROWS_AS(pool.value(popped), stale_handle);
+#endif
+      }
+    }
+
+    WHEN("the pool is shrunk and grows again"){
+      const auto popped = l;
+      l = pool.pop(l);
+      pool.shrink_to_fit();
+      auto l2 = pool.push(3, pool.new_stack());
+      THEN("the dropped address kept its generation"){
+        REQUIRE(traits::index(l2) == traits::index(popped));
+        REQUIRE(traits::generation(l2) == traits::generation(popped) + 1);
+        REQUIRE(pool.value(l2) == 3);
+        REQUIRE(pool.value(l) == 1);
+#if STACK_POOL_CHECK_HANDLES
+        REQUIRE_THROWS_AS(pool.value(popped), stale_handle);
+#endif
+      }
+    }
+  }
+
+  GIVEN("a pool whose handles have room for 15 nodes only"){
+    stack_pool<int, generational<std::uint8_t, 4>, soa_layout> pool{};
+    auto l = pool.push_n(15, 0, pool.new_stack());
+    THEN("a 16th node does not fit"){
+      REQUIRE_THROWS_AS(pool.push(1, l), std::length_error);
+      l = pool.pop(l);
+      l = pool.push(1, l);
+      REQUIRE(pool.value(l) == 1);
+      REQUIRE(std::distance(pool.begin(l), pool.end(l)) == 15);
+    }
+  }
+}
+
+SCENARIO("rewiring stacks in place"){
+  GIVEN("a pool of strings with two stacks"){
+    stack_pool<std::string, uint16_t> pool{};
+    auto l1 = pool.new_stack();
+    for (auto s : {"e", "d", "c", "b", "a"})
+      l1 = pool.push(s, l1);
+    auto l2 = pool.push("z", pool.new_stack());
+    const auto capacity = pool.capacity();
+    const std::string* a = &pool.value(l1);
+    auto values = [&](decltype(l1) l) { return std::vector<std::string>(pool.begin(l), pool.end(l)); };
+
+    WHEN("a stack is reversed"){
+      l1 = pool.reverse(l1);
+      THEN("its nodes are linked the other way"){
+        REQUIRE(values(l1) == std::vector<std::string>{"e", "d", "c", "b", "a"});
+        REQUIRE(pool.reverse(pool.new_stack()) == pool.new_stack());
+      }
+    }
+
+    WHEN("a stack is split"){
+      auto parts = pool.split_at(l1, 2);
+      THEN("the first k nodes and the rest are two stacks"){
+        REQUIRE(values(parts.first) == std::vector<std::string>{"a", "b"});
+        REQUIRE(values(parts.second) == std::vector<std::string>{"c", "d", "e"});
+        REQUIRE(pool.split_at(l1, 0).first == pool.new_stack());
+        REQUIRE(pool.split_at(parts.second, 10).second == pool.new_stack());
+      }
+    }
+
+    WHEN("the top of a stack is moved on another"){
+      std::tie(l1, l2) = pool.splice_top(l1, l2, 3);
+      THEN("the nodes keep their order"){
+        REQUIRE(values(l1) == std::vector<std::string>{"d", "e"});
+        REQUIRE(values(l2) == std::vector<std::string>{"a", "b", "c", "z"});
+      }
+      std::tie(l1, l2) = pool.splice_top(l1, l2, 10);
+      THEN("moving more nodes than the stack has moves all of them"){
+        REQUIRE(pool.empty(l1));
+        REQUIRE(values(l2) == std::vector<std::string>{"d", "e", "a", "b", "c", "z"});
+      }
+    }
+
+    WHEN("two sorted stacks are merged"){
+      auto l3 = pool.new_stack();
+      for (auto s : {"f", "c", "b"})
+        l3 = pool.push(s, l3);
+      auto m = pool.merge_sorted(l1, l3);
+      THEN("the result is sorted and equal values of the first stack come first"){
+        REQUIRE(values(m) == std::vector<std::string>{"a", "b", "b", "c", "c", "d", "e", "f"});
+        REQUIRE(&pool.value(pool.next(m)) == &pool.value(pool.next(l1)));
+        REQUIRE(pool.merge_sorted(m, pool.new_stack()) == m);
+      }
+    }
+
+    WHEN("stacks sorted the other way are merged"){
+      l1 = pool.reverse(l1);
+      auto m = pool.merge_sorted(l2, l1, std::greater<std::string>{});
+      THEN("the comparison is used"){
+        REQUIRE(values(m) == std::vector<std::string>{"z", "e", "d", "c", "b", "a"});
+      }
+    }
+
+    THEN("nothing is allocated and no value moves"){
+      l1 = pool.reverse(l1);
+      std::tie(l1, l2) = pool.splice_top(l1, l2, 2);
+      l2 = pool.merge_sorted(pool.reverse(l2), l1);
+      REQUIRE(pool.capacity() == capacity);
+      REQUIRE(std::find_if(pool.begin(l2), pool.end(l2), [&](const std::string& s) { return &s == a; }) != pool.end(l2));
+    }
+  }
+}
+
+SCENARIO("sorting a stack in place"){
+  GIVEN("a stack of random pairs, scattered in the pool"){
+    using item = std::pair<int, int>;
+    stack_pool<item, std::uint32_t> pool{};
+    std::vector<item> expected;
+    auto l = pool.new_stack();
+    auto other = pool.new_stack();
+    std::srand(7);
+    for (int i = 0; i < 1000; ++i) {
+      const item x{std::rand() % 50, i};
+      expected.push_back(x);
+      l = pool.push(x, l);
+      other = pool.push(x, other);
+      if (i % 3 == 0)
+        other = pool.pop(other);
+    }
+    std::reverse(expected.begin(), expected.end());
+    const auto capacity = pool.capacity();
+    const item* top = &pool.value(l);
+    auto by_key = [](const item& a, const item& b) { return a.first < b.first; };
+
+    WHEN("it is sorted by the first element"){
+      l = pool.sort(l, by_key);
+      std::stable_sort(expected.begin(), expected.end(), by_key);
+      THEN("it is sorted, stable, and no node moved"){
+        REQUIRE(std::vector<item>(pool.begin(l), pool.end(l)) == expected);
+        REQUIRE(pool.capacity() == capacity);
+        REQUIRE(std::find_if(pool.begin(l), pool.end(l), [&](const item& x) { return &x == top; }) != pool.end(l));
+      }
+    }
+
+    WHEN("it is sorted with the default comparison"){
+      l = pool.sort(l);
+      THEN("it is sorted"){
+        REQUIRE(std::is_sorted(pool.begin(l), pool.end(l)));
+        REQUIRE(std::distance(pool.begin(l), pool.end(l)) == 1000);
+      }
+    }
+  }
+
+  GIVEN("short stacks"){
+    stack_pool<int> pool{};
+    THEN("sorting them works as well"){
+      REQUIRE(pool.sort(pool.new_stack()) == pool.new_stack());
+      auto l = pool.push(1, pool.new_stack());
+      REQUIRE(pool.sort(l) == l);
+      l = pool.push(2, l);
+      l = pool.push(0, l);
+      l = pool.sort(l, std::greater<int>{});
+      REQUIRE(std::vector<int>(pool.begin(l), pool.end(l)) == std::vector<int>{2, 1, 0});
+    }
+  }
+}
+
+TEMPLATE_TEST_CASE("scanning the live nodes without following the stacks", "", aos_layout, soa_layout, segmented_layout<3>){
+  stack_pool<int, std::uint32_t, TestType> pool{};
+  std::vector<std::uint32_t> heads(10, pool.new_stack());
+  for (int i = 0; i < 1000; ++i)
+    heads[i % 10] = pool.push(i, heads[i % 10]);
+  // leave holes all over the pool
+  for (int s = 0; s < 10; s += 3)
+    heads[s] = pool.pop_n(heads[s], 40);
+  heads[1] = pool.pop(heads[1]);
+
+  auto expected = [&](std::function<void(int)> f) {
+    for (auto h : heads)
+      std::for_each(pool.begin(h), pool.end(h), f);
+  };
+  auto check = [&]() {
+    long sum = 0, count = 0;
+    int max = -1;
+    expected([&](int x) { sum += x; max = std::max(max, x); count += x % 3 == 0; });
+    long swept = 0;
+    pool.sweep([&](int x) { swept += x; });
+    REQUIRE(swept == sum);
+    REQUIRE(pool.reduce_live(0L, [](long a, int b) { return a + b; }) == sum);
+    REQUIRE(pool.reduce_live(0, std::plus<int>{}) == int(sum));
+    REQUIRE(pool.reduce_live(-1, [](int a, int b) { return std::max(a, b); }) == max);
+    REQUIRE(long(pool.count_live([](int x) { return x % 3 == 0; })) == count);
+  };
+
+  check();
+  pool.sweep([](int& x) { x *= 2; });
+  check();
+
+  // freeing through a descriptor does not walk the stack
+  auto d = pool.describe(heads[4]);
+  d = pool.free_stack(d);
+  heads[4] = d.head;
+  check();
+  heads[4] = pool.push(7, heads[4]);
+  check();
+
+  const auto copy = pool;
+  REQUIRE(copy.reduce_live(0, std::plus<int>{}) == pool.reduce_live(0, std::plus<int>{}));
+
+  pool.shrink_to_fit();
+  check();
+  heads = pool.compact(heads);
+  check();
+  heads[0] = pool.free_stack(heads[0]);
+  check();
+}
+
+TEMPLATE_TEST_CASE("choosing which free node a push reuses", "", lifo_reuse, lowest_address_reuse, nearest_head_reuse){
+  using pool_type = stack_pool<int, std::uint32_t, aos_layout, std::allocator<int>, count_stats, TestType>;
+  pool_type pool{};
+  std::vector<std::uint32_t> heads(20, pool.new_stack());
+  std::vector<std::vector<int>> expected(20);
+  std::srand(5);
+  for (int i = 0; i < 20000; ++i) {
+    const auto k = std::size_t(std::rand()) % heads.size();
+    switch (std::rand() % 8) {
+      case 0:
+        heads[k] = pool.pop_n(heads[k], 5);
+        expected[k].resize(expected[k].size() - std::min<std::size_t>(5, expected[k].size()));
+        break;
+      case 1:
+        if (!pool.empty(heads[k]))
+          heads[k] = pool.free_stack(heads[k]);
+        expected[k].clear();
+        break;
+      case 2:
+      case 3:
+        heads[k] = pool.pop(heads[k]);
+        if (!expected[k].empty())
+          expected[k].pop_back();
+        break;
+      default:
+        heads[k] = pool.push(i, heads[k]);
+        expected[k].push_back(i);
+    }
+  }
+
+  auto check = [&](const pool_type& p, const std::vector<std::uint32_t>& h) {
+    std::size_t live = 0;
+    for (std::size_t k = 0; k < h.size(); ++k) {
+      REQUIRE(std::equal(p.begin(h[k]), p.end(h[k]), expected[k].rbegin(), expected[k].rend()));
+      live += expected[k].size();
+    }
+    REQUIRE(p.stats().live_nodes == live);
+    REQUIRE(p.count_live([](int) { return true; }) == live);
+  };
+  check(pool, heads);
+
+  // no node is taken twice, nor one past the used ones
+  const auto capacity = pool.capacity();
+  const auto free = pool.stats().free_nodes;
+  auto extra = pool.new_stack();
+  for (std::size_t i = 0; i < free; ++i)
+    extra = pool.push(-1, extra);
+  REQUIRE(pool.capacity() == capacity);
+  extra = pool.free_stack(extra);
+  check(pool, heads);
+
+  auto d = pool.describe(heads[0]);
+  pool.free_stack(d);
+  heads[0] = pool.new_stack();
+  expected[0].clear();
+  check(pool, heads);
+  heads[0] = pool.push(1, heads[0]);
+  expected[0].push_back(1);
+
+  pool.shrink_to_fit();
+  check(pool, heads);
+  heads[1] = pool.push(2, heads[1]);
+  expected[1].push_back(2);
+
+  std::stringstream image;
+  pool.save(image, heads);
+  pool_type loaded{};
+  check(loaded, loaded.load(image));
+  heads[2] = pool.push(3, heads[2]);
+  expected[2].push_back(3);
+
+  pool_type moved{std::move(pool)};
+  check(moved, heads);
+  heads = moved.compact(heads);
+  check(moved, heads);
+  heads[3] = moved.push(4, heads[3]);
+  expected[3].push_back(4);
+  check(moved, heads);
+}
+
+SCENARIO("reusing the free nodes in address order"){
+  GIVEN("a pool with holes"){
+    stack_pool<int, std::uint32_t, aos_layout, std::allocator<int>, no_stats, lowest_address_reuse> pool{};
+    auto l1 = pool.push_n(100, 1, pool.new_stack());  // nodes 100 (top) to 1
+    auto l2 = pool.push_n(100, 2, pool.new_stack());  // nodes 200 to 101
+    l2 = pool.pop_n(l2, 30);                           // frees 200 to 171
+    l1 = pool.pop_n(l1, 10);                           // frees 100 to 91
+
+    THEN("pushes take the lowest free addresses first"){
+      auto l3 = pool.new_stack();
+      for (std::uint32_t x = 91; x <= 100; ++x) {
+        l3 = pool.push(3, l3);
+        REQUIRE(l3 == x);
+      }
+      l3 = pool.push(3, l3);
+      REQUIRE(l3 == 171u);
+    }
+  }
+}
+
+SCENARIO("reusing the free nodes near the head of the stack"){
+  GIVEN("a pool with holes on both sides of a stack"){
+    stack_pool<int, std::uint32_t, aos_layout, std::allocator<int>, no_stats, nearest_head_reuse> pool{};
+    std::vector<std::uint32_t> heads(2, pool.new_stack());
+    for (int i = 0; i < 2000; ++i)
+      heads[i % 2] = pool.push(i, heads[i % 2]);  // stack 0 on odd addresses
+    heads[1] = pool.pop_n(heads[1], 1000);         // free all the even ones
+    heads[0] = pool.pop_n(heads[0], 500);          // and the odd ones from 1001 on
+
+    THEN("a push takes the free node closest to its head"){
+      auto x = pool.push(0, heads[0]);
+      REQUIRE(x == 1000u);  // next to the head, 999
+      x = pool.push(0, x);
+      REQUIRE(x == 1001u);
+    }
+    THEN("a new stack takes the lowest free address"){
+      REQUIRE(pool.push(0, pool.new_stack()) == 2u);
+    }
+  }
+}
+
+TEMPLATE_TEST_CASE("rolling back the changes made since a checkpoint", "", (std::tuple<std::uint32_t, lifo_reuse>),
+                   (std::tuple<std::uint32_t, lowest_address_reuse>), (std::tuple<generational<std::uint32_t, 8>, lifo_reuse>)){
+  using handle = typename std::tuple_element<0, TestType>::type;
+  using reuse = typename std::tuple_element<1, TestType>::type;
+  using pool_type = stack_pool<std::string, handle, aos_layout, std::allocator<std::string>, count_stats, reuse>;
+  using traits = handle_traits<handle>;
+  pool_type pool{};
+  std::vector<typename traits::type> heads(6, pool.new_stack());
+  for (int i = 0; i < 300; ++i)
+    heads[i % 6] = pool.push(std::string(20, char('a' + i % 26)), heads[i % 6]);
+  heads[0] = pool.pop_n(heads[0], 10);  // some free nodes before the checkpoint
+  heads[5] = pool.free_stack(heads[5]);
+
+  auto contents = [&]() {
+    std::vector<std::vector<std::string>> c;
+    for (auto h : heads)
+      c.emplace_back(pool.begin(h), pool.end(h));
+    return c;
+  };
+  const auto before = contents();
+  const auto saved_heads = heads;
+  const auto stats = pool.stats();
+  const auto capacity = pool.capacity();
+  const pool_type reference{pool};
+
+  auto change_everything = [&]() {
+    for (int i = 0; i < 100; ++i)
+      heads[i % 3] = pool.push(std::to_string(i), heads[i % 3]);
+    heads[1] = pool.pop_n(heads[1], 70);
+    heads[2] = pool.pop(heads[2]);
+    heads[3] = pool.reverse(heads[3]);
+    std::tie(heads[4], heads[0]) = pool.splice_top(heads[4], heads[0], 5);
+    heads[4] = pool.sort(heads[4]);
+    auto d = pool.concat(pool.describe(heads[2]), pool.describe(heads[3]));
+    heads[2] = d.head;
+    heads[3] = pool.new_stack();
+    heads[5] = pool.push_n(30, "x", heads[5]);
+    pool.free_stack(pool.describe(heads[2]));
+    heads[2] = pool.new_stack();
+  };
+
+  auto cp = pool.checkpoint();
+  change_everything();
+  REQUIRE(contents() != before);
+  pool.rollback(cp);
+  heads = saved_heads;
+  REQUIRE(contents() == before);
+  REQUIRE(pool.stats().live_nodes == stats.live_nodes);
+  REQUIRE(pool.stats().free_nodes == stats.free_nodes);
+  REQUIRE(pool.capacity() >= capacity);
+  REQUIRE(std::size_t(pool.count_live([](const std::string&) { return true; })) == stats.live_nodes);
+
+  SECTION("the free nodes are those of the checkpoint") {
+    pool_type untouched{reference};
+    for (int i = 0; i < 20; ++i)
+      REQUIRE(traits::index(pool.push("y", pool.new_stack())) == traits::index(untouched.push("y", untouched.new_stack())));
+  }
+
+  SECTION("a committed checkpoint keeps the changes and frees the popped nodes") {
+    cp = pool.checkpoint();
+    change_everything();
+    const auto after = contents();
+    const auto live = pool.stats().live_nodes;
+    pool.commit(cp);
+    REQUIRE(contents() == after);
+    REQUIRE(pool.stats().live_nodes == live);
+    REQUIRE(std::size_t(pool.count_live([](const std::string&) { return true; })) == live);
+    const auto free = pool.stats().free_nodes;
+    const auto size = pool.capacity();
+    auto extra = pool.new_stack();
+    for (std::size_t i = 0; i < free; ++i)
+      extra = pool.push("z", extra);
+    REQUIRE(pool.capacity() == size);
+  }
+
+  SECTION("checkpoints nest") {
+    auto outer = pool.checkpoint();
+    heads[0] = pool.push("outer", heads[0]);
+    const auto middle = contents();
+    const auto middle_heads = heads;
+    auto inner = pool.checkpoint();
+    change_everything();
+    REQUIRE_THROWS_AS(pool.commit(outer), std::logic_error);
+    REQUIRE_THROWS_AS(pool.compact(heads), std::logic_error);
+    pool.rollback(inner);
+    heads = middle_heads;
+    REQUIRE(contents() == middle);
+
+    inner = pool.checkpoint();
+    change_everything();
+    pool.commit(inner);
+    pool.rollback(outer);
+    heads = saved_heads;
+    REQUIRE(contents() == before);
+
+    // a node new to outer, popped, reused under inner and popped again once inner is committed
+    outer = pool.checkpoint();
+    auto filler = pool.new_stack();
+    for (std::size_t i = 0; i < stats.free_nodes; ++i)
+      filler = pool.push("f", filler);
+    auto b = pool.push(std::string(30, 'b'), pool.new_stack());
+    b = pool.pop(b);
+    inner = pool.checkpoint();
+    b = pool.push(std::string(30, 'c'), b);
+    pool.commit(inner);
+    b = pool.pop(b);
+    pool.rollback(outer);
+    REQUIRE(contents() == before);
+    REQUIRE(std::size_t(pool.count_live([](const std::string&) { return true; })) == stats.live_nodes);
+  }
+
+  SECTION("the nodes popped since a checkpoint are no longer live") {
+    const auto all = [](const std::string&) { return true; };
+    const auto length = [](std::size_t n, const std::string& v) { return n + v.size(); };
+    const auto live = pool.count_live(all);
+    const auto total = pool.reduce_live(std::size_t(0), length);
+    const auto top = heads[1];
+    const auto popped = pool.value(top).size();
+    auto swept = [&]() {
+      std::size_t n = 0;
+      pool.sweep([&n](std::string&) { ++n; });
+      return n;
+    };
+
+    cp = pool.checkpoint();
+    heads[1] = pool.pop(heads[1]);
+    REQUIRE(pool.count_live(all) == live - 1);
+    REQUIRE(pool.reduce_live(std::size_t(0), length) == total - popped);
+    REQUIRE(swept() == live - 1);
+#if STACK_POOL_CHECK_HANDLES
+    if (traits::generational)
+      REQUIRE_THROWS_AS(pool.value(top), stale_handle);
+#endif
+    pool.rollback(cp);
+    REQUIRE(pool.value(top).size() == popped);
+    REQUIRE(pool.count_live(all) == live);
+
+    cp = pool.checkpoint();
+    heads[1] = pool.pop(top);
+    pool.commit(cp);
+    REQUIRE(pool.count_live(all) == live - 1);
+    REQUIRE(swept() == live - 1);
+#if STACK_POOL_CHECK_HANDLES
+    if (traits::generational)
+      REQUIRE_THROWS_AS(pool.value(top), stale_handle);
+#endif
+  }
+
+  SECTION("the nodes pushed after a rollback get valid handles") {
+    cp = pool.checkpoint();
+    const auto stale = pool.push_n(stats.free_nodes + 3, "s", pool.new_stack());
+    pool.rollback(cp);
+    auto h = pool.push_n(stats.free_nodes, "r", pool.new_stack());  // the free nodes first
+    h = pool.push("a", h);
+    h = pool.push_n(2, "b", h);
+    const std::vector<std::string> v{"c", "d"};
+    h = pool.push_range(v.begin(), v.end(), h);
+    REQUIRE(std::vector<std::string>(pool.begin(h), std::next(pool.begin(h), 5)) ==
+            std::vector<std::string>{"d", "c", "b", "b", "a"});
+    REQUIRE(std::distance(pool.begin(h), pool.end(h)) == std::ptrdiff_t(stats.free_nodes + 5));
+    h = pool.pop_n(h, 5);
+    REQUIRE(pool.value(h) == "r");
+#if STACK_POOL_CHECK_HANDLES
+    if (traits::generational)
+      REQUIRE_THROWS_AS(pool.value(stale), stale_handle);
+#endif
+    (void)stale;
+  }
+}
@@ -0,0 +1,237 @@
+#include "catch.hpp"
+
+#include "concurrent_stack_pool.hpp"
+#include "parallel_stacks.hpp"
+#include <algorithm>  // max_element
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+SCENARIO("a concurrent pool used by a single thread") {
+  GIVEN("a pool with two stacks") {
+    concurrent_stack_pool<int> pool{};
+    auto l1 = pool.new_stack();
+    REQUIRE(l1 == pool.end());
+
+    l1 = pool.push(10, l1);
+    REQUIRE(l1 == 1);
+    l1 = pool.push(11, l1);
+    REQUIRE(l1 == 2);
+
+    auto l2 = pool.new_stack();
+    l2 = pool.push(20, l2);
+    REQUIRE(l2 == 3);
+
+    WHEN("we pop a node") {
+      l1 = pool.pop(l1);
+      THEN("the node is reused by the next push") {
+        l2 = pool.push(21, l2);
+        REQUIRE(l2 == 2);
+        REQUIRE(pool.value(l2) == 21);
+        REQUIRE(pool.value(pool.next(l2)) == 20);
+        REQUIRE(pool.size() == 3);
+      }
+    }
+
+    WHEN("we free a whole stack") {
+      l1 = pool.free_stack(l1);
+      REQUIRE(pool.empty(l1));
+      THEN("its nodes are reused") {
+        l2 = pool.push(21, l2);
+        l2 = pool.push(22, l2);
+        REQUIRE(pool.size() == 3);
+        REQUIRE(*std::max_element(pool.begin(l2), pool.end(l2)) == 22);
+      }
+    }
+  }
+}
+
+SCENARIO("growing a concurrent pool keeps the values in place") {
+  concurrent_stack_pool<int, std::uint32_t> pool{};
+  auto l = pool.new_stack();
+  const int n = 5000;  // spans several chunks
+  for (int i = 0; i < n; ++i)
+    l = pool.push(i, l);
+
+  REQUIRE(pool.capacity() >= std::size_t(n));
+  int expected = n;
+  for (auto it = pool.cbegin(l); it != pool.cend(l); ++it)
+    REQUIRE(*it == --expected);
+  REQUIRE(expected == 0);
+}
+
+SCENARIO("many threads push and pop on their own stacks") {
+  concurrent_stack_pool<int> pool{};
+  const unsigned n_threads = 4;
+  const int depth = 100;
+  std::vector<std::uint32_t> heads(n_threads);
+  std::vector<std::thread> threads;
+
+  for (unsigned t = 0; t < n_threads; ++t)
+    threads.emplace_back([&pool, &heads, t, depth]() {
+      auto l = pool.new_stack();
+      for (int round = 0; round < 200; ++round) {
+        for (int i = 0; i < depth; ++i)
+          l = pool.push(int(t) * depth + i, l);
+        for (int i = 0; i < depth; ++i)
+          l = pool.pop(l);
+      }
+      for (int i = 0; i < depth; ++i)
+        l = pool.push(int(t) * depth + i, l);
+      heads[t] = l;
+    });
+  for (auto& t : threads)
+    t.join();
+
+  THEN("every stack holds exactly its own values") {
+    for (unsigned t = 0; t < n_threads; ++t) {
+      int expected = int(t) * depth + depth;
+      for (auto it = pool.begin(heads[t]); it != pool.end(heads[t]); ++it)
+        REQUIRE(*it == --expected);
+      REQUIRE(expected == int(t) * depth);
+    }
+  }
+
+  THEN("freed nodes were recycled instead of taking new ones") {
+    REQUIRE(pool.size() <= n_threads * depth * 2);
+  }
+}
+
+SCENARIO("threads recycling nodes through their magazines") {
+  using pool_type = concurrent_stack_pool<int>;
+  pool_type pool{};
+
+  GIVEN("a magazine with batches of 4 nodes") {
+    pool_type::magazine m{pool, 4};
+    auto l = pool.new_stack();
+    l = pool.push(1, l, m);
+
+    THEN("the first push takes a whole batch of fresh nodes") {
+      REQUIRE(pool.size() == 4);
+      REQUIRE(m.size() == 3);
+      REQUIRE(m.refills() == 1);
+    }
+
+    WHEN("we free more than two batches") {
+      for (int i = 2; i <= 12; ++i)
+        l = pool.push(i, l, m);
+      l = pool.free_stack(l, m);
+      THEN("the oldest batch is flushed to the shared list") {
+        REQUIRE(m.flushes() == 1);
+        REQUIRE(m.size() == 8);
+        auto other = pool.push(42, pool.new_stack());
+        REQUIRE(other <= 12);
+        REQUIRE(pool.size() == 12);
+      }
+    }
+  }
+
+  GIVEN("many threads, each with its own magazine") {
+    const unsigned n_threads = 4;
+    const int depth = 100;
+    std::vector<std::uint32_t> heads(n_threads);
+    std::vector<std::thread> threads;
+
+    for (unsigned t = 0; t < n_threads; ++t)
+      threads.emplace_back([&pool, &heads, t, depth]() {
+        pool_type::magazine m{pool, 16};
+        auto l = pool.new_stack();
+        for (int round = 0; round < 200; ++round) {
+          for (int i = 0; i < depth; ++i)
+            l = pool.push(int(t) * depth + i, l, m);
+          l = pool.free_stack(l, m);
+        }
+        for (int i = 0; i < depth; ++i)
+          l = pool.push(int(t) * depth + i, l, m);
+        heads[t] = l;
+      });
+    for (auto& t : threads)
+      t.join();
+
+    THEN("every stack holds exactly its own values") {
+      for (unsigned t = 0; t < n_threads; ++t) {
+        int expected = int(t) * depth + depth;
+        for (auto it = pool.begin(heads[t]); it != pool.end(heads[t]); ++it)
+          REQUIRE(*it == --expected);
+        REQUIRE(expected == int(t) * depth);
+      }
+    }
+  }
+}
+
+SCENARIO("counting the nodes that go through the shared free list") {
+  GIVEN("a pool counting its traffic") {
+    concurrent_stack_pool<int, std::uint32_t, count_traffic> pool{};
+    auto l = pool.new_stack();
+    for (int i = 0; i < 3; ++i)
+      l = pool.push(i, l);
+    REQUIRE(pool.traffic().shared_nodes() == 0);  // fresh nodes
+
+    l = pool.pop(l);
+    l = pool.push(3, l);
+    REQUIRE(pool.traffic().shared_nodes() == 2);
+    REQUIRE(pool.traffic().shared_updates() == 2);
+
+    WHEN("a whole stack is freed and a magazine refills from the list") {
+      l = pool.free_stack(l);
+      REQUIRE(pool.traffic().shared_nodes() == 5);
+      REQUIRE(pool.traffic().shared_updates() == 3);
+      decltype(pool)::magazine m{pool, 4};
+      l = pool.push(4, l, m);
+      THEN("each splice is a single update") {
+        REQUIRE(pool.traffic().shared_nodes() == 8);
+        REQUIRE(pool.traffic().shared_updates() == 4);
+        REQUIRE(m.shared_traffic() == 3);
+      }
+    }
+  }
+}
+
+SCENARIO("reducing many stacks of a pool in parallel") {
+  stack_pool<int, std::uint32_t> pool{};
+  std::vector<std::uint32_t> heads;
+  std::vector<long> sums;
+  // very uneven stacks: a few long ones among many short ones
+  for (int s = 0; s < 2000; ++s) {
+    auto l = pool.new_stack();
+    long sum = 0;
+    const int length = s % 100 == 0 ? 5000 : s % 7;
+    for (int i = 0; i < length; ++i) {
+      l = pool.push(s + i, l);
+      sum += s + i;
+    }
+    heads.push_back(l);
+    sums.push_back(sum);
+  }
+
+  for (unsigned n_threads : {1u, 3u, 8u}) {
+    stack_workers workers{n_threads};
+    REQUIRE(workers.size() == n_threads);
+    auto result = transform_reduce_stacks(workers, pool, heads, 0L,
+                                          std::plus<long>{},
+                                          [](int x) { return long(x); });
+    REQUIRE(result == sums);
+
+    std::vector<std::size_t> lengths(heads.size());
+    for_each_stack(workers, heads, [&](std::size_t i, std::uint32_t head) {
+      lengths[i] = std::size_t(std::distance(pool.begin(head), pool.end(head)));
+    });
+    REQUIRE(lengths[100] == 5000);
+    REQUIRE(lengths[101] == 101 % 7);
+
+    // the workers can be used again after a job threw
+    REQUIRE_THROWS_AS(for_each_stack(workers, heads,
+                                     [](std::size_t i, std::uint32_t) {
+                                       if (i == 1234)
+                                         throw std::runtime_error{"boom"};
+                                     }),
+                      std::runtime_error);
+    auto maxima = transform_reduce_stacks(
+        workers, pool, heads, -1, [](int a, int b) { return std::max(a, b); },
+        [](int x) { return x; });
+    REQUIRE(maxima[100] == 100 + 4999);
+    REQUIRE(maxima[7] == -1);
+  }
+}
@@ -0,0 +1,58 @@
+#include "catch.hpp"
+
+#include "mapped_stack_pool.hpp"
+#include <cstdio>  // std::remove
+#include <vector>
+
+SCENARIO("a pool stored in a mapped file") {
+  const std::string path{"tests_mapped.pool"};
+  std::remove(path.c_str());
+
+  GIVEN("a new pool file with two stacks") {
+    {
+      mapped_stack_pool<int, std::uint32_t> pool{path, 4};
+      REQUIRE(pool.n_roots() == 4);
+      REQUIRE(pool.root(0) == pool.end());
+
+      auto l1 = pool.new_stack();
+      for (int i = 0; i < 5000; ++i)  // more than the initial capacity
+        l1 = pool.push(i, l1);
+      auto l2 = pool.push(42, pool.new_stack());
+      l2 = pool.push(43, l2);
+      l2 = pool.pop(l2);
+
+      pool.root(0) = l1;
+      pool.root(1) = l2;
+      pool.sync();
+    }
+
+    WHEN("we open the file again") {
+      mapped_stack_pool<int, std::uint32_t> pool{path};
+
+      THEN("every stack is there") {
+        REQUIRE(pool.n_roots() == 4);
+        REQUIRE(pool.size() == 5002);
+        auto l1 = pool.root(0);
+        int expected = 5000;
+        for (auto it = pool.cbegin(l1); it != pool.cend(l1); ++it)
+          REQUIRE(*it == --expected);
+        REQUIRE(expected == 0);
+        REQUIRE(pool.value(pool.root(1)) == 42);
+      }
+
+      THEN("the free list is there as well") {
+        auto l3 = pool.push(7, pool.new_stack());
+        REQUIRE(l3 == 5002);
+      }
+    }
+
+    WHEN("we open it with a different value type") {
+      THEN("the file is refused") {
+        using other = mapped_stack_pool<double, std::uint32_t>;
+        REQUIRE_THROWS_AS(other{path}, std::runtime_error);
+      }
+    }
+  }
+
+  std::remove(path.c_str());
+}
@@ -0,0 +1,125 @@
+#include "catch.hpp"
+
+#include "persistent_stack_pool.hpp"
+#include <cstdint>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+SCENARIO("versions of a stack share their nodes") {
+  GIVEN("a stack and a version pushed on it") {
+    persistent_stack_pool<int> pool{};
+    auto base = pool.new_stack();
+    for (int i = 0; i < 5; ++i)
+      base = pool.push(i, base);
+    auto child = pool.push(42, pool.share(base));
+
+    THEN("the version reuses every node of the stack") {
+      REQUIRE(pool.nodes() == 6);
+      REQUIRE(pool.next(child) == base);
+      REQUIRE(pool.use_count(base) == 2);
+      REQUIRE(pool.use_count(child) == 1);
+      REQUIRE(std::vector<int>(pool.begin(child), pool.end(child)) ==
+              std::vector<int>{42, 4, 3, 2, 1, 0});
+    }
+
+    WHEN("the stack is popped") {
+      base = pool.pop(base);
+      THEN("the shared top stays for the version") {
+        REQUIRE(pool.nodes() == 6);
+        REQUIRE(pool.value(base) == 3);
+        REQUIRE(pool.use_count(base) == 2);
+        REQUIRE(std::vector<int>(pool.begin(child), pool.end(child)) ==
+                std::vector<int>{42, 4, 3, 2, 1, 0});
+      }
+    }
+
+    WHEN("the version is freed") {
+      child = pool.free_stack(child);
+      THEN("only its own node is freed") {
+        REQUIRE(pool.empty(child));
+        REQUIRE(pool.nodes() == 5);
+        REQUIRE(pool.use_count(base) == 1);
+        REQUIRE(std::vector<int>(pool.begin(base), pool.end(base)) ==
+                std::vector<int>{4, 3, 2, 1, 0});
+      }
+      AND_WHEN("the stack is freed too") {
+        base = pool.free_stack(base);
+        THEN("no node is left, and the next pushes reuse them") {
+          REQUIRE(pool.nodes() == 0);
+          const auto capacity = pool.capacity();
+          auto x = pool.new_stack();
+          for (int i = 0; i < 6; ++i)
+            x = pool.push(i, x);
+          REQUIRE(pool.capacity() == capacity);
+          pool.free_stack(x);
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("a search tree of persistent stacks keeps only the distinct nodes") {
+  persistent_stack_pool<std::string, std::uint32_t> pool{};
+  std::vector<std::uint32_t> versions{pool.new_stack()};
+  std::vector<std::vector<std::string>> expected{{}};
+  std::mt19937 gen{11};
+
+  const auto live_nodes = [&]() {
+    std::set<std::uint32_t> reached;
+    for (auto v : versions)
+      for (auto x = v; !pool.empty(x); x = pool.next(x))
+        reached.insert(x);
+    return reached.size();
+  };
+
+  for (int i = 0; i < 3000; ++i) {
+    const auto k = gen() % versions.size();
+    const auto op = gen() % 8;
+    if (op < 4) {  // a new version, one value longer
+      versions.push_back(pool.push(std::to_string(i), pool.share(versions[k])));
+      expected.push_back(expected[k]);
+      expected.back().push_back(std::to_string(i));
+    } else if (op < 6) {  // the version loses its top
+      versions[k] = pool.pop(versions[k]);
+      if (!expected[k].empty())
+        expected[k].pop_back();
+    } else if (versions.size() > 1) {  // the version is dropped
+      pool.free_stack(versions[k]);
+      versions.erase(versions.begin() + k);
+      expected.erase(expected.begin() + k);
+    }
+    if (i % 500 == 0)
+      REQUIRE(pool.nodes() == live_nodes());
+  }
+
+  std::size_t total = 0;
+  for (std::size_t k = 0; k < versions.size(); ++k) {
+    REQUIRE(std::vector<std::string>(pool.begin(versions[k]), pool.end(versions[k])) ==
+            std::vector<std::string>(expected[k].rbegin(), expected[k].rend()));
+    total += expected[k].size();
+  }
+  REQUIRE(pool.nodes() == live_nodes());
+  REQUIRE(pool.nodes() < total);
+
+  for (auto v : versions)
+    pool.free_stack(v);
+  REQUIRE(pool.nodes() == 0);
+}
+
+TEST_CASE("a reference count that would overflow throws") {
+  persistent_stack_pool<int, std::uint16_t, std::uint8_t> pool{};
+  auto x = pool.push(1, pool.new_stack());
+  for (int i = 1; i < 255; ++i)
+    pool.share(x);
+  REQUIRE(pool.use_count(x) == 255);
+  REQUIRE_THROWS_AS(pool.share(x), std::length_error);
+  auto y = pool.push(2, x);  // takes one of the references to x, adds none
+  REQUIRE(pool.use_count(x) == 255);
+  pool.share(y);
+  REQUIRE_THROWS_AS(pool.pop(y), std::length_error);  // y is shared, x would get one more
+  REQUIRE(pool.use_count(y) == 2);
+  REQUIRE(pool.use_count(x) == 255);
+}
@@ -0,0 +1,130 @@
+#include "catch.hpp"
+
+#include "pool_memory_resource.hpp"
+#include <algorithm>
+#include <list>
+#include <map>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// forwards to new and delete, counting the calls
+struct counting_resource : std::pmr::memory_resource {
+  std::size_t allocations = 0;
+  std::size_t deallocations = 0;
+
+  void* do_allocate(std::size_t bytes, std::size_t align) override {
+    ++allocations;
+    return std::pmr::new_delete_resource()->allocate(bytes, align);
+  }
+  void do_deallocate(void* p, std::size_t bytes, std::size_t align) override {
+    ++deallocations;
+    std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+  }
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+};
+
+SCENARIO("allocating blocks from a pool_memory_resource") {
+  GIVEN("a resource of 40 byte blocks, 4 per chunk at first") {
+    counting_resource upstream;
+    {
+      pool_memory_resource pool{36, 4, &upstream};
+      REQUIRE(pool.block_size() == 40);
+      REQUIRE(pool.upstream_resource() == &upstream);
+      REQUIRE(pool.chunk_bytes() == 0);
+
+      WHEN("blocks are allocated") {
+        std::vector<char*> blocks;
+        for (int i = 0; i < 4; ++i)
+          blocks.push_back(static_cast<char*>(pool.allocate(40, 8)));
+        THEN("they are contiguous in one chunk") {
+          REQUIRE(upstream.allocations == 1);
+          for (int i = 1; i < 4; ++i)
+            REQUIRE(blocks[i] - blocks[i - 1] == 40);
+        }
+        AND_WHEN("the chunk is full") {
+          void* p = pool.allocate(8, 8);
+          THEN("a chunk twice as large is taken") {
+            REQUIRE(p != nullptr);
+            REQUIRE(upstream.allocations == 2);
+            REQUIRE(pool.chunk_bytes() >= 12 * 40);
+          }
+        }
+        AND_WHEN("blocks are deallocated") {
+          pool.deallocate(blocks[1], 40, 8);
+          pool.deallocate(blocks[2], 40, 8);
+          THEN("they are reused last in, first out") {
+            REQUIRE(pool.allocate(40, 8) == blocks[2]);
+            REQUIRE(pool.allocate(40, 8) == blocks[1]);
+            REQUIRE(upstream.allocations == 1);
+          }
+        }
+      }
+
+      WHEN("a block is too large or too aligned") {
+        void* p = pool.allocate(41, 8);
+        void* q = pool.allocate(16, 16);
+        THEN("it comes from upstream") {
+          REQUIRE(upstream.allocations == 2);
+          REQUIRE(pool.chunk_bytes() == 0);
+          pool.deallocate(p, 41, 8);
+          pool.deallocate(q, 16, 16);
+          REQUIRE(upstream.deallocations == 2);
+        }
+      }
+
+      WHEN("the resource is released") {
+        void* p = pool.allocate(40, 8);
+        void* q = pool.allocate(40, 8);
+        REQUIRE(p != q);
+        pool.release();
+        THEN("its chunks go back upstream") {
+          REQUIRE(upstream.deallocations == upstream.allocations);
+          REQUIRE(pool.chunk_bytes() == 0);
+        }
+      }
+    }
+    REQUIRE(upstream.deallocations == upstream.allocations);
+  }
+}
+
+TEST_CASE("node-based containers on a pool_memory_resource") {
+  pool_memory_resource pool{96};
+  std::mt19937 gen{3};
+  std::pmr::list<int> list{&pool};
+  std::pmr::map<int, std::pmr::string> map{&pool};
+  std::pmr::unordered_map<int, int> hash{&pool};
+  std::list<int> expected_list;
+  std::map<int, std::string> expected_map;
+
+  for (int i = 0; i < 5000; ++i) {
+    const int k = gen() % 1000;
+    if (gen() % 4 == 0) {
+      map.erase(k);
+      expected_map.erase(k);
+      hash.erase(k);
+      if (!list.empty()) {
+        list.pop_front();
+        expected_list.pop_front();
+      }
+    } else {
+      map.emplace(k, std::to_string(k));
+      expected_map.emplace(k, std::to_string(k));
+      ++hash[k];
+      list.push_back(k);
+      expected_list.push_back(k);
+    }
+  }
+
+  REQUIRE(std::equal(list.begin(), list.end(), expected_list.begin(), expected_list.end()));
+  REQUIRE(map.size() == expected_map.size());
+  for (const auto& kv : expected_map) {
+    REQUIRE(map.at(kv.first) == kv.second.c_str());
+    REQUIRE(hash.count(kv.first) == 1);
+  }
+  REQUIRE(hash.size() == map.size());
+}
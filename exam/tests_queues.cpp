@@ -0,0 +1,184 @@
+#include "catch.hpp"
+
+#include "queue_pool.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+TEMPLATE_TEST_CASE("queues hold the same values as std::queue", "",
+                   (queue_pool<int>), (queue_pool<int, std::uint32_t>)) {
+  TestType pool{};
+  std::vector<typename TestType::queue_type> queues(10, pool.new_queue());
+  std::vector<std::queue<int>> expected(10);
+  std::mt19937 gen{7};
+
+  for (int i = 0; i < 2000; ++i) {
+    const auto k = gen() % queues.size();
+    if (gen() % 3 != 0) {
+      queues[k] = pool.enqueue(i, queues[k]);
+      expected[k].push(i);
+    } else if (!expected[k].empty()) {
+      REQUIRE(pool.front(queues[k]) == expected[k].front());
+      queues[k] = pool.dequeue(queues[k]);
+      expected[k].pop();
+    }
+  }
+
+  for (std::size_t k = 0; k < queues.size(); ++k) {
+    REQUIRE(pool.size(queues[k]) == expected[k].size());
+    if (!expected[k].empty())
+      REQUIRE(pool.back(queues[k]) == expected[k].back());
+    auto it = pool.cbegin(queues[k]);
+    for (; !expected[k].empty(); expected[k].pop(), ++it)
+      REQUIRE(*it == expected[k].front());
+    REQUIRE(it == pool.cend(queues[k]));
+  }
+}
+
+SCENARIO("enqueueing and dequeueing") {
+  GIVEN("an empty queue") {
+    queue_pool<std::string, std::uint32_t> pool{16};
+    auto q = pool.new_queue();
+    REQUIRE(pool.empty(q));
+    REQUIRE(pool.begin(q) == pool.end(q));
+
+    WHEN("values are enqueued") {
+      q = pool.enqueue("a", q);
+      q = pool.emplace(q, 3, 'b');
+      q = pool.enqueue(std::string{"c"}, q);
+
+      THEN("they come out in the same order") {
+        REQUIRE(pool.size(q) == 3);
+        REQUIRE(pool.front(q) == "a");
+        REQUIRE(pool.back(q) == "c");
+        q = pool.dequeue(q);
+        REQUIRE(pool.front(q) == "bbb");
+        q = pool.dequeue(q);
+        q = pool.dequeue(q);
+        REQUIRE(pool.empty(q));
+        AND_THEN("dequeueing an empty queue does nothing") {
+          q = pool.dequeue(q);
+          REQUIRE(pool.empty(q));
+        }
+        AND_THEN("the queue can be filled again") {
+          q = pool.enqueue("d", q);
+          REQUIRE(pool.front(q) == "d");
+          REQUIRE(pool.back(q) == "d");
+        }
+      }
+
+      THEN("freeing the queue gives its nodes back to the pool") {
+        q = pool.free_queue(q);
+        REQUIRE(pool.empty(q));
+        const auto capacity = pool.capacity();
+        for (int i = 0; i < 3; ++i)
+          q = pool.enqueue("e", q);
+        REQUIRE(pool.capacity() == capacity);
+      }
+    }
+  }
+}
+
+TEMPLATE_TEST_CASE("deques hold the same values as std::deque", "",
+                   (deque_pool<int>), (deque_pool<int, std::uint32_t>)) {
+  TestType pool{};
+  std::vector<typename TestType::deque_type> deques(10, pool.new_deque());
+  std::vector<std::deque<int>> expected(10);
+  std::mt19937 gen{11};
+
+  for (int i = 0; i < 4000; ++i) {
+    const auto k = gen() % deques.size();
+    switch (gen() % 6) {
+      case 0:
+      case 1:
+        deques[k] = pool.push_front(i, deques[k]);
+        expected[k].push_front(i);
+        break;
+      case 2:
+      case 3:
+        deques[k] = pool.push_back(i, deques[k]);
+        expected[k].push_back(i);
+        break;
+      case 4:
+        if (!expected[k].empty()) {
+          REQUIRE(pool.front(deques[k]) == expected[k].front());
+          deques[k] = pool.pop_front(deques[k]);
+          expected[k].pop_front();
+        }
+        break;
+      default:
+        if (!expected[k].empty()) {
+          REQUIRE(pool.back(deques[k]) == expected[k].back());
+          deques[k] = pool.pop_back(deques[k]);
+          expected[k].pop_back();
+        }
+    }
+  }
+
+  for (std::size_t k = 0; k < deques.size(); ++k) {
+    const auto& d = deques[k];
+    REQUIRE(pool.size(d) == expected[k].size());
+    REQUIRE(std::equal(pool.cbegin(d), pool.cend(d), expected[k].begin(),
+                       expected[k].end()));
+
+    // and backwards, following the links to the previous nodes
+    std::vector<int> backwards;
+    for (auto x = d.back; x != pool.end(); x = pool.prev(x))
+      backwards.push_back(pool.value(x));
+    REQUIRE(std::equal(backwards.begin(), backwards.end(),
+                       expected[k].rbegin(), expected[k].rend()));
+  }
+}
+
+SCENARIO("pushing and popping at both ends of a deque") {
+  GIVEN("a deque with one value") {
+    deque_pool<std::string, std::uint32_t> pool{};
+    auto d = pool.push_back("b", pool.new_deque());
+    REQUIRE(d.front == d.back);
+
+    WHEN("values are pushed at both ends") {
+      d = pool.push_front("a", d);
+      d = pool.emplace_back(d, 2, 'c');
+      THEN("they are linked both ways") {
+        REQUIRE(pool.size(d) == 3);
+        REQUIRE(pool.front(d) == "a");
+        REQUIRE(pool.back(d) == "cc");
+        REQUIRE(pool.prev(d.front) == pool.end());
+        REQUIRE(pool.next(d.back) == pool.end());
+        REQUIRE(pool.value(pool.next(d.front)) == "b");
+        REQUIRE(pool.value(pool.prev(d.back)) == "b");
+      }
+      AND_WHEN("the deque is emptied from the back") {
+        for (int i = 0; i < 3; ++i)
+          d = pool.pop_back(d);
+        THEN("both ends are the end of the pool") {
+          REQUIRE(pool.empty(d));
+          REQUIRE(d.front == pool.end());
+          REQUIRE(d.back == pool.end());
+        }
+      }
+      AND_WHEN("the deque is freed") {
+        const auto capacity = pool.capacity();
+        d = pool.free_deque(d);
+        REQUIRE(pool.empty(d));
+        THEN("its nodes are reused") {
+          for (int i = 0; i < 3; ++i)
+            d = pool.push_front("x", d);
+          REQUIRE(pool.capacity() == capacity);
+        }
+      }
+    }
+
+    WHEN("the only value is popped from the front") {
+      d = pool.pop_front(d);
+      THEN("the deque is empty") {
+        REQUIRE(pool.empty(d));
+        REQUIRE(d.back == pool.end());
+      }
+    }
+  }
+}
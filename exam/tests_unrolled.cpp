@@ -0,0 +1,94 @@
+#include "catch.hpp"
+
+#include "unrolled_stack_pool.hpp"
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <vector>
+
+TEMPLATE_TEST_CASE("unrolled stacks hold the same values as plain ones", "",
+                   (unrolled_stack_pool<int, 1>),
+                   (unrolled_stack_pool<int, 4, std::uint32_t>),
+                   (unrolled_stack_pool<int, 16>)) {
+  TestType pool{};
+  stack_pool<int> plain{};
+  auto l = pool.new_stack();
+  auto p = plain.new_stack();
+  REQUIRE(pool.empty(l));
+  REQUIRE(pool.begin(l) == pool.end(l));
+
+  for (int i = 0; i < 100; ++i) {
+    l = pool.push(i, l);
+    p = plain.push(i, p);
+    if (i % 7 == 3) {
+      l = pool.pop(l);
+      p = plain.pop(p);
+    }
+  }
+  REQUIRE(pool.value(l) == plain.value(p));
+  REQUIRE(std::equal(pool.begin(l), pool.end(l), plain.begin(p), plain.end(p)));
+
+  for (int i = 0; i < 50; ++i) {
+    l = pool.pop(l);
+    p = plain.pop(p);
+  }
+  REQUIRE(std::equal(pool.cbegin(l), pool.cend(l), plain.cbegin(p), plain.cend(p)));
+
+  while (!pool.empty(l))
+    l = pool.pop(l);
+  p = plain.free_stack(p);
+  REQUIRE(pool.begin(l) == pool.end(l));
+}
+
+SCENARIO("filling and emptying the nodes of an unrolled stack") {
+  GIVEN("a pool with room for 8 values per node") {
+    unrolled_stack_pool<int, 8, std::uint32_t> pool{64};
+    REQUIRE(pool.capacity() == 64);
+    auto l = pool.new_stack();
+    for (int i = 0; i < 8; ++i)
+      l = pool.push(i, l);
+    const auto first = l;
+
+    THEN("a full node keeps its address") {
+      REQUIRE(l == first);
+      REQUIRE(pool.count(l) == 8);
+      l = pool.push(8, l);
+      REQUIRE(l != first);
+      REQUIRE(pool.count(l) == 1);
+      l = pool.pop(l);
+      REQUIRE(l == first);
+      REQUIRE(pool.value(l) == 7);
+    }
+
+    WHEN("the stack is freed") {
+      for (int i = 8; i < 20; ++i)
+        l = pool.push(i, l);
+      l = pool.free_stack(l);
+      REQUIRE(pool.empty(l));
+      THEN("its nodes are reused") {
+        auto l2 = pool.push(1, pool.new_stack());
+        l2 = pool.push(2, l2);
+        REQUIRE(pool.capacity() == 64);
+        REQUIRE(std::vector<int>(pool.begin(l2), pool.end(l2)) == std::vector<int>{2, 1});
+      }
+    }
+  }
+
+  GIVEN("a pool of strings") {
+    unrolled_stack_pool<std::string, 3> pool{};
+    auto l = pool.new_stack();
+    for (int i = 0; i < 10; ++i)
+      l = pool.push(std::string(30, char('a' + i)), l);
+    THEN("values survive the growth of the pool and copies") {
+      l = pool.push(pool.value(l), l);
+      l = pool.emplace(l, 30, 'z');
+      auto copy = pool;
+      l = pool.pop(l);
+      REQUIRE(pool.value(l) == std::string(30, 'j'));
+      REQUIRE(std::distance(copy.begin(l), copy.end(l)) == 12);
+      REQUIRE(copy.value(l) == std::string(30, 'z'));
+      REQUIRE(*std::next(pool.begin(l), 10) == std::string(30, 'a'));
+      l = pool.free_stack(l);
+    }
+  }
+}
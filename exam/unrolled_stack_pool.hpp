@@ -0,0 +1,239 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "stack_pool.hpp"
+
+/*
+  the nodes of an unrolled_stack_pool: up to K values and their count.
+  values[0] is the bottom of the node and values[count - 1] its top.
+  trivial values are kept in a plain array, so that the blocks are
+  trivially copyable and the pool keeps its memcpy fast paths; other
+  values are built and destroyed one by one as they come and go.
+*/
+template <typename T, std::size_t K>
+using _unrolled_count =
+    typename std::conditional<(K <= 0xff), std::uint8_t,
+                              typename std::conditional<(K <= 0xffff), std::uint16_t,
+                                                        std::uint32_t>::type>::type;
+
+// tag for the constructor of a block holding its first value
+struct _first_value {};
+
+template <typename T, std::size_t K, bool = std::is_trivial<T>::value>
+struct _unrolled_block {
+  _unrolled_count<T, K> count;
+  T values[K];
+
+  template <typename... Args>
+  explicit _unrolled_block(_first_value, Args&&... args) : count{0} {
+    emplace(std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  void emplace(Args&&... args) {
+    ::new (static_cast<void*>(&values[count])) T(std::forward<Args>(args)...);
+    ++count;
+  }
+  void pop() noexcept { --count; }
+  bool full() const noexcept { return count == K; }
+};
+
+template <typename T, std::size_t K>
+struct _unrolled_block<T, K, false> {
+  _unrolled_count<T, K> count;
+  union {
+    T values[K];
+  };
+
+  template <typename... Args>
+  explicit _unrolled_block(_first_value, Args&&... args) : count{0} {
+    emplace(std::forward<Args>(args)...);
+  }
+
+  _unrolled_block(const _unrolled_block& other) : count{0} {
+    fill(other.count, [&other](std::size_t i) -> const T& { return other.values[i]; });
+  }
+  _unrolled_block(_unrolled_block&& other) noexcept(std::is_nothrow_move_constructible<T>::value)
+      : count{0} {
+    fill(other.count, [&other](std::size_t i) -> T&& { return std::move(other.values[i]); });
+  }
+  _unrolled_block& operator=(const _unrolled_block&) = delete;
+  _unrolled_block& operator=(_unrolled_block&&) = delete;
+
+  ~_unrolled_block() {
+    while (count > 0)
+      pop();
+  }
+
+  template <typename... Args>
+  void emplace(Args&&... args) {
+    ::new (static_cast<void*>(&values[count])) T(std::forward<Args>(args)...);
+    ++count;
+  }
+  void pop() noexcept { values[--count].~T(); }
+  bool full() const noexcept { return count == K; }
+
+ private:
+  // the destructor of a block is not run if its constructor throws
+  template <typename Get>
+  void fill(std::size_t n, Get get) {
+    try {
+      while (count < n)
+        emplace(get(count));
+    } catch (...) {
+      while (count > 0)
+        pop();
+      throw;
+    }
+  }
+};
+
+template <typename pool_type, typename T, typename N>
+class _unrolled_iterator {
+  pool_type* p;
+  N block;
+  std::size_t i;  // one past the current value in the block, 0 at the end
+
+ public:
+  using value_type = T;
+  using reference = value_type&;
+  using pointer = value_type*;
+  using difference_type = std::ptrdiff_t;
+  using iterator_category = std::forward_iterator_tag;
+
+  _unrolled_iterator(pool_type* pool, N x)
+      : p{pool}, block{x}, i{x == N(0) ? std::size_t(0) : std::size_t(pool->blocks.value(x).count)} {}
+
+  reference operator*() const { return p->blocks.value(block).values[i - 1]; }
+
+  _unrolled_iterator& operator++() {
+    if (--i == 0) {
+      block = p->blocks.next(block);
+      if (block != N(0))
+        i = p->blocks.value(block).count;
+    }
+    return *this;
+  }
+
+  _unrolled_iterator operator++(int) {
+    auto tmp = *this;
+    ++(*this);
+    return tmp;
+  }
+
+  friend bool operator==(const _unrolled_iterator& x, const _unrolled_iterator& y) {
+    return x.block == y.block && x.i == y.i;
+  }
+
+  friend bool operator!=(const _unrolled_iterator& x, const _unrolled_iterator& y) {
+    return !(x == y);
+  }
+};
+
+/*
+  a pool of unrolled stacks: every node holds up to K values, so that a
+  stack of small values spends one link every K values instead of one
+  per value, and a traversal reads K values from each node it reaches.
+  push fills the node on top of the stack and takes a new node only
+  when it is full; pop empties it and frees it with its last value. the
+  nodes are kept in a stack_pool, whose free list recycles them.
+
+  a stack is still known by the address of its top node, which changes
+  only when a node is taken or freed: as with stack_pool, always use the
+  address returned by push and pop. iterators give the values from the
+  top, exactly as they would on a stack_pool.
+*/
+template <typename T, std::size_t K, typename N = std::size_t>
+class unrolled_stack_pool {
+  static_assert(K > 0, "a node must hold at least one value");
+
+  using block = _unrolled_block<T, K>;
+  stack_pool<block, N> blocks;
+
+  using stack_type = N;
+  using value_type = T;
+  using size_type = std::size_t;
+
+  template <typename P, typename V, typename M>
+  friend class _unrolled_iterator;
+
+ public:
+  unrolled_stack_pool() = default;
+  explicit unrolled_stack_pool(size_type n) : blocks{(n + K - 1) / K} {}  // room for n values
+
+  using iterator = _unrolled_iterator<unrolled_stack_pool, value_type, stack_type>;
+  using const_iterator = _unrolled_iterator<const unrolled_stack_pool, const value_type, stack_type>;
+
+  iterator begin(stack_type x) { return iterator{this, x}; }
+  iterator end(stack_type) { return iterator{this, end()}; }
+
+  const_iterator begin(stack_type x) const { return const_iterator{this, x}; }
+  const_iterator end(stack_type) const { return const_iterator{this, end()}; }
+
+  const_iterator cbegin(stack_type x) const { return const_iterator{this, x}; }
+  const_iterator cend(stack_type) const { return const_iterator{this, end()}; }
+
+  stack_type new_stack() const noexcept { return end(); }  // return an empty stack
+
+  // room for n values in full nodes
+  void reserve(size_type n) { blocks.reserve((n + K - 1) / K); }
+  size_type capacity() const noexcept { return blocks.capacity() * K; }
+  void shrink_to_fit() { blocks.shrink_to_fit(); }
+
+  bool empty(stack_type x) const noexcept { return x == end(); }
+
+  stack_type end() const noexcept { return stack_type(0); }
+
+  // the value on top of the stack
+  T& value(stack_type x) noexcept { return top(blocks.value(x)); }
+  const T& value(stack_type x) const noexcept { return top(blocks.value(x)); }
+
+  // the number of values held by the top node of the stack
+  size_type count(stack_type x) const noexcept { return blocks.value(x).count; }
+
+  stack_type push(const T& val, stack_type head) { return _push(head, val); }
+  stack_type push(T&& val, stack_type head) { return _push(head, std::move(val)); }
+
+  template <typename... Args>
+  stack_type emplace(stack_type head, Args&&... args) {
+    return _push(head, std::forward<Args>(args)...);
+  }
+
+  stack_type pop(stack_type x) noexcept {
+    if (empty(x))
+      return x;
+    block& b = blocks.value(x);
+    if (b.count > 1) {
+      b.pop();
+      return x;
+    }
+    return blocks.pop(x);
+  }
+
+  stack_type free_stack(stack_type x) noexcept {
+    return empty(x) ? x : blocks.free_stack(x);
+  }
+
+ private:
+  static T& top(block& b) noexcept { return b.values[b.count - 1]; }
+  static const T& top(const block& b) noexcept { return b.values[b.count - 1]; }
+
+  /*
+    a new node is pushed (and its value built) by stack_pool, which
+    takes care of a value living in the pool itself.
+  */
+  template <typename... Args>
+  stack_type _push(stack_type head, Args&&... args) {
+    if (!empty(head) && !blocks.value(head).full()) {
+      blocks.value(head).emplace(std::forward<Args>(args)...);
+      return head;
+    }
+    return blocks.emplace(head, _first_value{}, std::forward<Args>(args)...);
+  }
+};